@@ -2,18 +2,24 @@
 #include "include/tsc.h"
 #include "include/pit.h"
 #include "include/export.h"
+#include "include/bl-utils.h"
 
 static bl_uint64_t ticks_per_ms = 0;
+static bl_uint64_t ticks_per_us = 0;
 
 void bl_time_setup(void)
 {
-	bl_uint64_t start, diff;
+	bl_uint64_t start, diff, rem;
 
 	start = bl_rdtsc();
 	bl_pit_channel2_sleep(0x9f41); // About 32 ms.
 	diff = bl_rdtsc() - start;
 
 	ticks_per_ms = diff >> 5;
+
+	bl_divmod64(diff, 32000, &ticks_per_us, &rem);
+	if (!ticks_per_us)
+		ticks_per_us = 1;
 }
 
 bl_uint64_t bl_time_sleep(bl_uint64_t ms)
@@ -28,3 +34,41 @@ bl_uint64_t bl_time_sleep(bl_uint64_t ms)
 }
 BL_EXPORT_FUNC(bl_time_sleep);
 
+void bl_time_udelay(bl_uint64_t us)
+{
+	bl_uint64_t end;
+
+	end = bl_time_deadline(us);
+
+	while (!bl_time_deadline_expired(end)) ;
+}
+BL_EXPORT_FUNC(bl_time_udelay);
+
+bl_uint64_t bl_time_deadline(bl_uint64_t us)
+{
+	return bl_rdtsc() + us * ticks_per_us;
+}
+BL_EXPORT_FUNC(bl_time_deadline);
+
+int bl_time_deadline_expired(bl_uint64_t deadline)
+{
+	return bl_rdtsc() >= deadline;
+}
+BL_EXPORT_FUNC(bl_time_deadline_expired);
+
+bl_uint64_t bl_time_stamp(void)
+{
+	return bl_rdtsc();
+}
+BL_EXPORT_FUNC(bl_time_stamp);
+
+bl_uint64_t bl_time_elapsed_us(bl_uint64_t stamp)
+{
+	bl_uint64_t us, rem;
+
+	bl_divmod64(bl_rdtsc() - stamp, ticks_per_us, &us, &rem);
+
+	return us;
+}
+BL_EXPORT_FUNC(bl_time_elapsed_us);
+
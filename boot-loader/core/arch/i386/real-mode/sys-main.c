@@ -9,6 +9,7 @@ void bl_die(void);
 void bl_init(void);
 void bl_print_set_output_callback(void (*)(const char *));
 
+extern bl_uint8_t __bl_image_start[];
 extern bl_uint8_t __bl_modules_start[];
 extern struct bl_module_list_header *bl_mod_list;
 
@@ -27,7 +28,9 @@ void bl_sys_main(void)
 
 	bl_heap_init();
 
-	bl_mod_list = (struct bl_module_list_header *)__bl_modules_start;
+	/* Only the start of the image is at its link address, modules are read from the copy. */
+	bl_mod_list = (struct bl_module_list_header *)(BL_BIOS_IMAGE_ADDRESS +
+		(__bl_modules_start - __bl_image_start));
 
 	bl_init();
 
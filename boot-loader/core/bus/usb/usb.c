@@ -59,6 +59,27 @@ void bl_usb_bulk_transfer(struct bl_usb_device *device, int direction,
 }
 BL_EXPORT_FUNC(bl_usb_bulk_transfer);
 
+void bl_usb_endpoint_bulk_transfer(struct bl_usb_device *device,
+	struct bl_usb_endpoint *endp, void *data, int length)
+{
+	device->controller->funcs->bulk_transfer(device->controller,
+		device->address, endp, device->speed,
+		endp->descriptor->endpoint_address & 0x80 ? 0 : 1,
+		(u8 *)data, length);
+}
+BL_EXPORT_FUNC(bl_usb_endpoint_bulk_transfer);
+
+bl_status_t bl_usb_endpoint_alloc_streams(struct bl_usb_device *device,
+	struct bl_usb_endpoint *endp, int *streams)
+{
+	if (!device->controller->funcs->alloc_streams)
+		return BL_STATUS_UNSUPPORTED;
+
+	return device->controller->funcs->alloc_streams(device->controller,
+		device->address, endp, streams);
+}
+BL_EXPORT_FUNC(bl_usb_endpoint_alloc_streams);
+
 bl_usb_transfer_info_t bl_usb_interrupt_transfer(struct bl_usb_device *device,
 	struct bl_usb_endpoint *endp, void *data, int length)
 {
@@ -494,6 +515,7 @@ static bl_status_t bl_usb_claim_storage_device(struct bl_usb_device *device)
 		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
 
 	disk->type = BL_STORAGE_TYPE_USB_DRIVE;
+	disk->controller = NULL;
 	disk->data = device;
 	disk->next = NULL;
 
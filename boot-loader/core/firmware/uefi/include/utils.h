@@ -7,6 +7,10 @@ efi_status_t bl_efi_locate_handle_buffer(efi_locate_search_type_t, efi_guid_t *,
 	void *, efi_uintn_t *, efi_handle_t **);
 efi_status_t bl_efi_open_protocol(efi_handle_t, efi_guid_t *, void **, efi_uint32_t);
 efi_status_t bl_efi_get_loaded_image(struct efi_loaded_image_protocol **);
+efi_status_t bl_efi_create_event(efi_uint32_t, efi_tpl_t, efi_event_notify_t,
+	void *, efi_event_t *);
+efi_status_t bl_efi_check_event(efi_event_t);
+efi_status_t bl_efi_close_event(efi_event_t);
 
 #endif
 
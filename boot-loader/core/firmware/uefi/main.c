@@ -5,15 +5,20 @@
 #include "firmware/uefi/include/utils.h"
 #include "core/include/loader/loader.h"
 #include "core/include/memory/heap.h"
+#include "core/include/storage/storage.h"
 
 #define EFI_MODULES_FILE_PATH	L"\\BLMODLST"
 
+/* Optional disk image next to the module list, served as a RAM disk. */
+#define EFI_RAMDISK_FILE_PATH	L"\\BLRAMDSK"
+
 extern void bl_efi_set_console(void);
 extern bl_status_t bl_init(void);
 
 extern struct bl_module_list_header *bl_mod_list;
 
-static efi_status_t bl_efi_read_file(struct efi_file_protocol *file, void **addr)
+static efi_status_t bl_efi_read_file(struct efi_file_protocol *file, void **addr,
+	efi_uintn_t *size)
 {
 	efi_status_t status;
 	efi_guid_t file_info_guid = EFI_FILE_INFO_ID_GUID;
@@ -37,6 +42,7 @@ static efi_status_t bl_efi_read_file(struct efi_file_protocol *file, void **addr
 		goto _exit;
 
 	*addr = ptr;
+	*size = file_size;
 
 _exit:
 	return status;
@@ -88,6 +94,25 @@ _exit:
 	return status;
 }
 
+static void bl_efi_load_ramdisk(void)
+{
+	efi_status_t status;
+	void *addr = NULL;
+	efi_uintn_t size;
+	struct efi_file_protocol *ramdisk_file;
+
+	status = bl_efi_get_file(EFI_RAMDISK_FILE_PATH, &ramdisk_file);
+	if (EFI_FAILED(status))
+		return;
+
+	status = bl_efi_read_file(ramdisk_file, &addr, &size);
+	if (EFI_FAILED(status) || !addr)
+		return;
+
+	/* Registered before bl_init(), so it is probed with the other disks. */
+	bl_ramdisk_create(addr, size);
+}
+
 static void bl_set_efi_info(efi_handle_t *image_handle, struct efi_system_table *system_table)
 {
 	bl_image_handle = image_handle;
@@ -98,6 +123,7 @@ efi_status_t bl_main(efi_handle_t image_handle, struct efi_system_table *system_
 {
 	efi_status_t status;
 	void *addr = NULL;
+	efi_uintn_t size;
 	struct efi_file_protocol *modules_file;
 
 	bl_set_efi_info(image_handle, system_table);
@@ -110,12 +136,14 @@ efi_status_t bl_main(efi_handle_t image_handle, struct efi_system_table *system_
 	if (EFI_FAILED(status))
 		goto _exit;
 
-	status = bl_efi_read_file(modules_file, &addr);
+	status = bl_efi_read_file(modules_file, &addr, &size);
 	if (EFI_FAILED(status))
 		goto _exit;
 
 	bl_mod_list = (struct bl_module_list_header *)addr;
 
+	bl_efi_load_ramdisk();
+
 	if (bl_init()) {
 		status = EFI_LOAD_ERROR;
 		goto _exit;
@@ -1,9 +1,26 @@
 #include "firmware/uefi/include/tables.h"
 #include "include/export.h"
+#include "include/time.h"
+#include "include/tsc.h"
+#include "include/bl-utils.h"
+
+/* Short calibration window - deadlines are timeouts, they don't need better precision. */
+#define BL_TIME_CALIBRATION_US	1000
+
+static bl_uint64_t ticks_per_us = 0;
 
 void bl_time_setup(void)
 {
+	bl_uint64_t start, diff, rem;
+
+	/* Deadlines are kept in TSC ticks, calibrate them against the firmware. */
+	start = bl_rdtsc();
+	bl_system_table->boot_services->stall(BL_TIME_CALIBRATION_US);
+	diff = bl_rdtsc() - start;
 
+	bl_divmod64(diff, BL_TIME_CALIBRATION_US, &ticks_per_us, &rem);
+	if (!ticks_per_us)
+		ticks_per_us = 1;
 }
 
 bl_uint64_t bl_time_sleep(bl_uint64_t ms)
@@ -31,3 +48,36 @@ bl_uint64_t bl_time_sleep(bl_uint64_t ms)
 }
 BL_EXPORT_FUNC(bl_time_sleep);
 
+void bl_time_udelay(bl_uint64_t us)
+{
+	bl_system_table->boot_services->stall(us);
+}
+BL_EXPORT_FUNC(bl_time_udelay);
+
+bl_uint64_t bl_time_deadline(bl_uint64_t us)
+{
+	return bl_rdtsc() + us * ticks_per_us;
+}
+BL_EXPORT_FUNC(bl_time_deadline);
+
+int bl_time_deadline_expired(bl_uint64_t deadline)
+{
+	return bl_rdtsc() >= deadline;
+}
+BL_EXPORT_FUNC(bl_time_deadline_expired);
+
+bl_uint64_t bl_time_stamp(void)
+{
+	return bl_rdtsc();
+}
+BL_EXPORT_FUNC(bl_time_stamp);
+
+bl_uint64_t bl_time_elapsed_us(bl_uint64_t stamp)
+{
+	bl_uint64_t us, rem;
+
+	bl_divmod64(bl_rdtsc() - stamp, ticks_per_us, &us, &rem);
+
+	return us;
+}
+BL_EXPORT_FUNC(bl_time_elapsed_us);
@@ -28,3 +28,22 @@ efi_status_t bl_efi_get_loaded_image(struct efi_loaded_image_protocol **loaded_i
 }
 BL_EXPORT_FUNC(bl_efi_get_loaded_image);
 
+efi_status_t bl_efi_create_event(efi_uint32_t type, efi_tpl_t tpl, efi_event_notify_t notify,
+	void *context, efi_event_t *event)
+{
+	return bl_system_table->boot_services->create_event(type, tpl, notify,
+		context, event);
+}
+BL_EXPORT_FUNC(bl_efi_create_event);
+
+efi_status_t bl_efi_check_event(efi_event_t event)
+{
+	return bl_system_table->boot_services->check_event(event);
+}
+BL_EXPORT_FUNC(bl_efi_check_event);
+
+efi_status_t bl_efi_close_event(efi_event_t event)
+{
+	return bl_system_table->boot_services->close_event(event);
+}
+BL_EXPORT_FUNC(bl_efi_close_event);
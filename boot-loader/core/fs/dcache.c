@@ -0,0 +1,305 @@
+#include "include/export.h"
+#include "include/string.h"
+#include "core/include/fs/fs.h"
+#include "core/include/video/print.h"
+#include "core/include/memory/heap.h"
+
+/*
+ * Directory entry cache, one per mount. Dentries are keyed on (parent, name),
+ * looked up through a small hash table and - once nothing refers to them -
+ * evicted in LRU order when the dentries, names & file data exceed
+ * BL_DCACHE_MAX_SIZE. File data is sized by the file system.
+ */
+
+static inline int bl_dcache_hash(struct bl_dcache *dcache, struct bl_dentry *parent,
+	const char *name)
+{
+	bl_uint32_t hash;
+
+	for (hash = (bl_addr_t)parent; *name; name++)
+		hash = hash * 31 + (dcache->case_insensitive ? bl_tolower(*name) : *name);
+
+	return hash & (BL_DCACHE_HASH_SIZE - 1);
+}
+
+static inline int bl_dcache_name_cmp(struct bl_dcache *dcache, const char *s1,
+	const char *s2)
+{
+	return dcache->case_insensitive ? bl_strcasecmp(s1, s2) : bl_strcmp(s1, s2);
+}
+
+static bl_size_t bl_dcache_entry_size(bl_fs_handle_t handle, bl_size_t len,
+	bl_file_data_t fdata)
+{
+	bl_size_t size;
+
+	size = sizeof(struct bl_dentry) + len + 1;
+	if (fdata && handle->fs->fdata_size)
+		size += handle->fs->fdata_size(fdata);
+
+	return size;
+}
+
+/* File data may grow while in use (FAT extents, ...), so charge it again. */
+static void bl_dcache_charge(bl_fs_handle_t handle, struct bl_dentry *dentry)
+{
+	handle->dcache.size -= dentry->size;
+	dentry->size = bl_dcache_entry_size(handle, bl_strlen(dentry->name), dentry->fdata);
+	handle->dcache.size += dentry->size;
+}
+
+static void bl_dcache_lru_unlink(struct bl_dcache *dcache, struct bl_dentry *dentry)
+{
+	if (dentry->prev)
+		dentry->prev->next = dentry->next;
+	else
+		dcache->lru_head = dentry->next;
+
+	if (dentry->next)
+		dentry->next->prev = dentry->prev;
+	else
+		dcache->lru_tail = dentry->prev;
+
+	dentry->prev = dentry->next = NULL;
+}
+
+static void bl_dcache_lru_push(struct bl_dcache *dcache, struct bl_dentry *dentry)
+{
+	dentry->prev = NULL;
+	dentry->next = dcache->lru_head;
+
+	if (dcache->lru_head)
+		dcache->lru_head->prev = dentry;
+	else
+		dcache->lru_tail = dentry;
+
+	dcache->lru_head = dentry;
+}
+
+static void bl_dcache_hash_remove(struct bl_dcache *dcache, struct bl_dentry *dentry)
+{
+	struct bl_dentry **p;
+
+	p = &dcache->hash[bl_dcache_hash(dcache, dentry->parent, dentry->name)];
+	while (*p) {
+		if (*p == dentry) {
+			*p = dentry->hash_next;
+			break;
+		}
+
+		p = &(*p)->hash_next;
+	}
+
+	dentry->hash_next = NULL;
+}
+
+static void bl_dcache_free(bl_fs_handle_t handle, struct bl_dentry *dentry)
+{
+	if (dentry->fdata)
+		handle->fs->close(dentry->fdata);
+
+	bl_heap_free(dentry->name, bl_strlen(dentry->name) + 1);
+	bl_heap_free(dentry, sizeof(struct bl_dentry));
+}
+
+/* Drop the least recently used dentry, its parent may become unreferenced. */
+static void bl_dcache_evict(bl_fs_handle_t handle)
+{
+	struct bl_dentry *dentry;
+	struct bl_dcache *dcache;
+
+	dcache = &handle->dcache;
+
+	dentry = dcache->lru_tail;
+
+	bl_dcache_lru_unlink(dcache, dentry);
+	bl_dcache_hash_remove(dcache, dentry);
+
+	dcache->size -= dentry->size;
+	dcache->stats.evictions++;
+
+	bl_dcache_put(handle, dentry->parent);
+
+	bl_dcache_free(handle, dentry);
+}
+
+void bl_dcache_init(bl_fs_handle_t handle)
+{
+	bl_memset(&handle->dcache, 0, sizeof(struct bl_dcache));
+
+	handle->dcache.case_insensitive = handle->fs->case_insensitive;
+}
+BL_EXPORT_FUNC(bl_dcache_init);
+
+struct bl_dentry *bl_dcache_lookup(bl_fs_handle_t handle, struct bl_dentry *parent,
+	const char *name)
+{
+	struct bl_dentry *dentry;
+	struct bl_dcache *dcache;
+
+	dcache = &handle->dcache;
+
+	dentry = dcache->hash[bl_dcache_hash(dcache, parent, name)];
+	while (dentry) {
+		if (dentry->parent == parent && !bl_dcache_name_cmp(dcache, dentry->name, name))
+			break;
+
+		dentry = dentry->hash_next;
+	}
+
+	if (!dentry)
+		dcache->stats.misses++;
+	else if (!dentry->fdata)
+		dcache->stats.negative_hits++;
+	else
+		dcache->stats.hits++;
+
+	/* Recently used. */
+	if (dentry && !dentry->refs) {
+		bl_dcache_lru_unlink(dcache, dentry);
+		bl_dcache_lru_push(dcache, dentry);
+	}
+
+	return dentry;
+}
+BL_EXPORT_FUNC(bl_dcache_lookup);
+
+/* The dentry is returned unreferenced, `fdata' is owned by the cache from now on. */
+struct bl_dentry *bl_dcache_add(bl_fs_handle_t handle, struct bl_dentry *parent,
+	const char *name, bl_file_data_t fdata, int directory)
+{
+	int hash;
+	bl_size_t len, size;
+	struct bl_dentry *dentry;
+	struct bl_dcache *dcache;
+
+	dcache = &handle->dcache;
+
+	len = bl_strlen(name);
+	size = bl_dcache_entry_size(handle, len, fdata);
+
+	/* Make room first, whatever the caller holds is referenced. */
+	while (dcache->lru_tail && dcache->size + size > BL_DCACHE_MAX_SIZE)
+		bl_dcache_evict(handle);
+
+	dentry = bl_heap_alloc(sizeof(struct bl_dentry));
+	if (!dentry)
+		return NULL;
+
+	dentry->name = bl_strndup(name, len);
+	if (!dentry->name) {
+		bl_heap_free(dentry, sizeof(struct bl_dentry));
+		return NULL;
+	}
+
+	dentry->parent = parent;
+	dentry->fdata = fdata;
+	dentry->directory = directory;
+	dentry->refs = 0;
+	dentry->size = size;
+	dentry->hash_next = NULL;
+
+	dcache->size += size;
+
+	/* The root has no name to be looked up by. */
+	if (!parent) {
+		dentry->prev = dentry->next = NULL;
+		return dentry;
+	}
+
+	bl_dcache_get(handle, parent);
+
+	hash = bl_dcache_hash(dcache, parent, name);
+	dentry->hash_next = dcache->hash[hash];
+	dcache->hash[hash] = dentry;
+
+	bl_dcache_lru_push(dcache, dentry);
+
+	return dentry;
+}
+BL_EXPORT_FUNC(bl_dcache_add);
+
+void bl_dcache_get(bl_fs_handle_t handle, struct bl_dentry *dentry)
+{
+	if (!dentry->refs++ && dentry->parent)
+		bl_dcache_lru_unlink(&handle->dcache, dentry);
+}
+BL_EXPORT_FUNC(bl_dcache_get);
+
+void bl_dcache_put(bl_fs_handle_t handle, struct bl_dentry *dentry)
+{
+	bl_dcache_charge(handle, dentry);
+
+	if (!--dentry->refs && dentry->parent)
+		bl_dcache_lru_push(&handle->dcache, dentry);
+}
+BL_EXPORT_FUNC(bl_dcache_put);
+
+void bl_dcache_get_stats(bl_fs_handle_t handle, struct bl_dcache_stats *stats)
+{
+	*stats = handle->dcache.stats;
+}
+BL_EXPORT_FUNC(bl_dcache_get_stats);
+
+void bl_dcache_dump_stats(bl_fs_handle_t handle)
+{
+	bl_print_str("Directory cache: ");
+
+	bl_print_str("Hits: ");
+	bl_print_decimal64(handle->dcache.stats.hits);
+	bl_print_str(" ");
+
+	bl_print_str("Negative hits: ");
+	bl_print_decimal64(handle->dcache.stats.negative_hits);
+	bl_print_str(" ");
+
+	bl_print_str("Misses: ");
+	bl_print_decimal64(handle->dcache.stats.misses);
+	bl_print_str(" ");
+
+	bl_print_str("Evictions: ");
+	bl_print_decimal64(handle->dcache.stats.evictions);
+	bl_print_str("\n");
+}
+BL_EXPORT_FUNC(bl_dcache_dump_stats);
+
+/*
+ * Drop all dentries & their file data, for unmount. Without open files every
+ * reference is held by a cached child, besides the one keeping the root.
+ */
+bl_status_t bl_dcache_invalidate(bl_fs_handle_t handle)
+{
+	int i, dentries, refs;
+	struct bl_dentry *dentry, *next;
+	struct bl_dcache *dcache;
+
+	dcache = &handle->dcache;
+
+	if (!dcache->root)
+		return BL_STATUS_SUCCESS;
+
+	dentries = 0;
+	refs = dcache->root->refs - 1;
+
+	for (i = 0; i < BL_DCACHE_HASH_SIZE; i++)
+		for (dentry = dcache->hash[i]; dentry; dentry = dentry->hash_next) {
+			dentries++;
+			refs += dentry->refs;
+		}
+
+	if (refs != dentries)
+		return BL_STATUS_FILE_SYSTEM_BUSY;
+
+	for (i = 0; i < BL_DCACHE_HASH_SIZE; i++)
+		for (dentry = dcache->hash[i]; dentry; dentry = next) {
+			next = dentry->hash_next;
+			bl_dcache_free(handle, dentry);
+		}
+
+	bl_dcache_free(handle, dcache->root);
+
+	bl_dcache_init(handle);
+
+	return BL_STATUS_SUCCESS;
+}
+BL_EXPORT_FUNC(bl_dcache_invalidate);
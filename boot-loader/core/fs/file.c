@@ -3,29 +3,104 @@
 #include "core/include/fs/fs.h"
 #include "core/include/memory/heap.h"
 
-bl_status_t bl_file_iterate_path(struct bl_fs *fs, const char *path,
+/* Look a path component up in the cache, asking the file system on a miss. */
+static bl_status_t bl_file_lookup(bl_fs_handle_t handle, struct bl_dentry *parent,
+	const char *filename, int directory, bl_fs_iterate_directory_callback_t callback,
+	struct bl_dentry **dentry)
+{
+	bl_status_t status;
+	struct bl_file_tree_node *node;
+
+	*dentry = bl_dcache_lookup(handle, parent, filename);
+	if (*dentry) {
+		if (!(*dentry)->fdata)
+			return BL_STATUS_FILE_NOT_FOUND;
+
+		if (!directory || (*dentry)->directory)
+			return BL_STATUS_SUCCESS;
+	}
+
+	node = NULL;
+	status = callback(filename, directory, parent->fdata, &node);
+	if (!status && !node)
+		return BL_STATUS_FILE_NOT_FOUND;
+
+	if (status) {
+		/* Remember names that don't exist. */
+		if (status == BL_STATUS_FILE_NOT_FOUND && !*dentry)
+			bl_dcache_add(handle, parent, filename, NULL, 0);
+
+		return status;
+	}
+
+	/* Cached, but not known to be a directory until now. */
+	if (*dentry) {
+		handle->fs->close(node->fdata);
+		bl_heap_free(node, sizeof(struct bl_file_tree_node));
+
+		(*dentry)->directory = 1;
+
+		return BL_STATUS_SUCCESS;
+	}
+
+	*dentry = bl_dcache_add(handle, parent, filename, node->fdata, directory);
+	if (!*dentry)
+		handle->fs->close(node->fdata);
+
+	bl_heap_free(node, sizeof(struct bl_file_tree_node));
+
+	return *dentry ? BL_STATUS_SUCCESS : BL_STATUS_MEMORY_ALLOCATION_FAILED;
+}
+
+bl_status_t bl_file_iterate_path(bl_fs_handle_t handle, const char *path,
 	struct bl_file_tree_node *root, bl_fs_iterate_directory_callback_t callback,
-	bl_file_data_t **fdata)
+	struct bl_dentry **dentry)
 {
 	bl_size_t len;
 	bl_status_t status;
 	char *copy_path, *filename, *next_filename;
-	struct bl_file_tree_node *top, *node;
+	struct bl_dentry *top, *next;
+	struct bl_dcache *dcache;
 	int directory;
 
 	static const char *bl_path_delimiter =  "/";
 	static const char *bl_current_directory = ".";
 	static const char *bl_previous_directory = "..";
 
-	if (!fs || !path || !root || !callback)
+	if (!handle || !path || !callback)
 		return BL_STATUS_INVALID_PARAMETERS;
 
+	dcache = &handle->dcache;
+
+	/* The first root node becomes the cached root, later opens pass none. */
+	if (!dcache->root) {
+		if (!root)
+			return BL_STATUS_INVALID_PARAMETERS;
+
+		dcache->root = bl_dcache_add(handle, NULL, "", root->fdata, 1);
+		if (!dcache->root) {
+			handle->fs->close(root->fdata);
+			bl_heap_free(root, sizeof(struct bl_file_tree_node));
+			return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+		}
+
+		/* Never evicted. */
+		bl_dcache_get(handle, dcache->root);
+
+		bl_heap_free(root, sizeof(struct bl_file_tree_node));
+	} else if (root) {
+		handle->fs->close(root->fdata);
+		bl_heap_free(root, sizeof(struct bl_file_tree_node));
+	}
+
 	len = bl_strlen(path);
 	copy_path = bl_strndup(path, len);
 	if (!copy_path)
 		return BL_STATUS_FAILURE;
 
-	top = root;
+	top = dcache->root;
+	bl_dcache_get(handle, top);
+
 	filename = bl_strtok(copy_path, bl_path_delimiter);
 
 	while (filename) {
@@ -40,40 +115,36 @@ bl_status_t bl_file_iterate_path(struct bl_fs *fs, const char *path,
 		}
 
 		if (!bl_strcmp(filename, bl_previous_directory)) {
-			if (top != root) {
-				node = top;
-				top = node->prev;
+			if (top->parent) {
+				next = top->parent;
 
-				fs->close(node->fdata);
-				bl_heap_free(node, sizeof(struct bl_file_tree_node));
+				bl_dcache_get(handle, next);
+				bl_dcache_put(handle, top);
+
+				top = next;
 			}
 		} else if (bl_strcmp(filename, bl_current_directory)) {
-			status = callback(filename, directory, top->fdata, &node);
-			if (status)
+			status = bl_file_lookup(handle, top, filename, directory, callback, &next);
+			if (status) {
+				bl_dcache_put(handle, top);
 				goto _exit;
+			}
 
-			node->prev = top;
-			top = node;
+			bl_dcache_get(handle, next);
+			bl_dcache_put(handle, top);
+
+			top = next;
 		}
 
 		filename = next_filename;
 	}
 
-	*fdata = top->fdata;
+	*dentry = top;
 
 	status = BL_STATUS_SUCCESS;
 
 _exit:
-	if (top) {
-		for (node = top->prev; node; node = node->prev) {
-			fs->close(node->fdata);
-			bl_heap_free(node, sizeof(struct bl_file_tree_node));
-		}
-
-		bl_heap_free(top, sizeof(struct bl_file_tree_node));
-	}
-
-	bl_heap_free(copy_path, len);
+	bl_heap_free(copy_path, len + 1);
 
 	return status;
 }
@@ -104,7 +175,9 @@ void bl_file_close(bl_file_t file)
 	if (!file || !file->handle || !file->handle->fs || !file->handle->fs->close)
 		return;
 
-	file->handle->fs->close(file->fdata);
+	bl_dcache_put(file->handle, file->dentry);
+
+	bl_heap_free(file, sizeof(struct bl_file));
 }
 
 bl_status_t bl_file_ls(bl_fs_handle_t handle, const char *path)
@@ -1,9 +1,12 @@
 #include "include/export.h"
 #include "core/include/fs/fs.h"
 #include "core/include/memory/heap.h"
+#include "core/include/video/print.h"
 
 static struct bl_fs *bl_fs_list = NULL;
 
+static struct bl_fs_handle *bl_fs_mounts = NULL;
+
 bl_fs_handle_t bl_fs_try_mount(struct bl_storage_device *disk, struct bl_partition *partition)
 {
 	bl_status_t status;
@@ -20,6 +23,11 @@ bl_fs_handle_t bl_fs_try_mount(struct bl_storage_device *disk, struct bl_partiti
 			status = fs->mount(disk, partition, &handle->info);
 			if (!status) {
 				handle->fs = fs;
+				bl_dcache_init(handle);
+
+				handle->next = bl_fs_mounts;
+				bl_fs_mounts = handle;
+
 				return handle;
 			}
 		}
@@ -30,6 +38,61 @@ bl_fs_handle_t bl_fs_try_mount(struct bl_storage_device *disk, struct bl_partiti
 	return NULL;
 }
 
+void bl_fs_dump_stats(bl_fs_handle_t handle)
+{
+	bl_dcache_dump_stats(handle);
+
+	if (handle->fs->dump_stats)
+		handle->fs->dump_stats(handle->info);
+}
+BL_EXPORT_FUNC(bl_fs_dump_stats);
+
+/* Cached dentries go first, so it fails while files of the mount are open. */
+bl_status_t bl_fs_umount(bl_fs_handle_t handle)
+{
+	bl_status_t status;
+	struct bl_fs_handle **p;
+
+	status = bl_dcache_invalidate(handle);
+	if (status)
+		return status;
+
+	if (handle->fs->umount) {
+		status = handle->fs->umount(handle->info);
+		if (status)
+			return status;
+	}
+
+	p = &bl_fs_mounts;
+	while (*p) {
+		if (*p == handle) {
+			*p = handle->next;
+			break;
+		}
+
+		p = &(*p)->next;
+	}
+
+	bl_heap_free(handle, sizeof(*handle));
+
+	return BL_STATUS_SUCCESS;
+}
+BL_EXPORT_FUNC(bl_fs_umount);
+
+void bl_fs_dump_mounts(void)
+{
+	int i;
+	struct bl_fs_handle *handle;
+
+	for (i = 0, handle = bl_fs_mounts; handle; i++, handle = handle->next) {
+		bl_print_str("Mount ");
+		bl_print_decimal64(i);
+		bl_print_str(":\n");
+
+		bl_fs_dump_stats(handle);
+	}
+}
+
 void bl_fs_register(struct bl_fs *fs)
 {
 	fs->next = bl_fs_list;
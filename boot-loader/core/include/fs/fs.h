@@ -9,19 +9,73 @@ struct bl_fs;
 /* File system specific info */
 typedef void *bl_fs_info_t;
 
+/* File. */
+typedef void *bl_file_data_t;
+
+/* Directory entry cache budget (dentries, names & file data, in bytes). */
+#define BL_DCACHE_HASH_SIZE	64
+#define BL_DCACHE_MAX_SIZE	0x8000
+
+/* Resolved path component, `fdata' is NULL for names known not to exist. */
+struct bl_dentry {
+	struct bl_dentry *parent;
+	char *name;
+
+	bl_file_data_t fdata;
+	int directory;
+
+	/* Children & open files. Only unreferenced dentries are evicted. */
+	int refs;
+
+	/* Bytes charged to the cache budget. */
+	bl_size_t size;
+
+	struct bl_dentry *hash_next;
+
+	/* LRU list of unreferenced dentries - head is most recently used. */
+	struct bl_dentry *prev;
+	struct bl_dentry *next;
+};
+
+struct bl_dcache_stats {
+	bl_uint64_t hits;
+	bl_uint64_t negative_hits;
+	bl_uint64_t misses;
+	bl_uint64_t evictions;
+};
+
+/* Shared by all files of a mount. */
+struct bl_dcache {
+	struct bl_dentry *root;
+	struct bl_dentry *hash[BL_DCACHE_HASH_SIZE];
+
+	struct bl_dentry *lru_head;
+	struct bl_dentry *lru_tail;
+
+	bl_size_t size;
+	struct bl_dcache_stats stats;
+
+	/* Names are hashed & compared regardless of case. */
+	int case_insensitive;
+};
+
 struct bl_fs_handle {
 	struct bl_fs *fs;
 	bl_fs_info_t info;
+
+	struct bl_dcache dcache;
+
+	struct bl_fs_handle *next;
 };
 typedef struct bl_fs_handle *bl_fs_handle_t;
 
-/* File. */
-typedef void *bl_file_data_t;
-
 struct bl_file {
 	char *name;
 	bl_fs_handle_t handle;
 	bl_file_data_t fdata;
+
+	/* Holds a reference while the file is open. */
+	struct bl_dentry *dentry;
 };
 typedef struct bl_file *bl_file_t;
 
@@ -35,6 +89,7 @@ struct bl_fs {
 
 	bl_status_t (*open)(bl_fs_handle_t, const char *, bl_file_t *);
 
+	/* Releases file data entirely, the cache calls it on eviction. */
 	bl_status_t (*close)(bl_file_data_t);
 
 	/* `ls -al`. Let it be file system proprietary. */
@@ -42,6 +97,15 @@ struct bl_fs {
 
 	bl_status_t (*read)(void);
 
+	/* Optional, memory held by file data - charged to the directory cache. */
+	bl_size_t (*fdata_size)(bl_file_data_t);
+
+	/* Optional, statistics of the file system's own caches. */
+	void (*dump_stats)(bl_fs_info_t);
+
+	/* Names match regardless of case (FAT, NTFS). */
+	int case_insensitive;
+
 	struct bl_fs *next;
 };
 
@@ -59,6 +123,9 @@ struct bl_file_tree_node {
 };
 
 bl_fs_handle_t bl_fs_try_mount(struct bl_storage_device *, struct bl_partition *);
+void bl_fs_dump_stats(bl_fs_handle_t);
+void bl_fs_dump_mounts(void);
+bl_status_t bl_fs_umount(bl_fs_handle_t);
 
 bl_file_t bl_file_open(bl_fs_handle_t, const char *);
 void bl_file_close(bl_file_t);
@@ -69,8 +136,22 @@ bl_status_t bl_file_ls(bl_fs_handle_t, const char *);
 typedef bl_status_t (*bl_fs_iterate_directory_callback_t)(const char *, int,
 	bl_file_data_t, struct bl_file_tree_node **);
 
-bl_status_t bl_file_iterate_path(struct bl_fs *,const char *, struct bl_file_tree_node *,
-	bl_fs_iterate_directory_callback_t, bl_file_data_t **);
+/*
+ * Takes over the root node, which is needed only while the mount has no cached
+ * root (NULL otherwise). The resolved dentry is returned referenced.
+ */
+bl_status_t bl_file_iterate_path(bl_fs_handle_t, const char *, struct bl_file_tree_node *,
+	bl_fs_iterate_directory_callback_t, struct bl_dentry **);
+
+void bl_dcache_init(bl_fs_handle_t);
+struct bl_dentry *bl_dcache_lookup(bl_fs_handle_t, struct bl_dentry *, const char *);
+struct bl_dentry *bl_dcache_add(bl_fs_handle_t, struct bl_dentry *, const char *,
+	bl_file_data_t, int);
+void bl_dcache_get(bl_fs_handle_t, struct bl_dentry *);
+void bl_dcache_put(bl_fs_handle_t, struct bl_dentry *);
+void bl_dcache_get_stats(bl_fs_handle_t, struct bl_dcache_stats *);
+void bl_dcache_dump_stats(bl_fs_handle_t);
+bl_status_t bl_dcache_invalidate(bl_fs_handle_t);
 
 void bl_fs_register(struct bl_fs *);
 void bl_fs_unregister(struct bl_fs *);
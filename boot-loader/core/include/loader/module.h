@@ -20,6 +20,9 @@ struct bl_module_header {
         bl_uint32_t size;
 } __attribute__((packed));
 
+/* BIOS stage 2 loads the whole image, module list included, here. */
+#define BL_BIOS_IMAGE_ADDRESS	0x100000
+
 /* Loaded module. */
 struct bl_segment {
         bl_uint8_t *address;
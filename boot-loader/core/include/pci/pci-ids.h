@@ -12,6 +12,8 @@
 # define BL_PCI_SUBCLASS_STORAGE_SATA		0x06
 #  define BL_PCI_PROG_IF_STORAGE_SATA_AHCI	0x01
 # define BL_PCI_SUBCLASS_STORAGE_SAS		0x07
+# define BL_PCI_SUBCLASS_STORAGE_NVM		0x08
+#  define BL_PCI_PROG_IF_STORAGE_NVM_NVME	0x02
 # define BL_PCI_SUBCLASS_STORAGE_OTHER		0x80
 
 #define BL_PCI_BASE_CLASS_DISPLAY			0x03
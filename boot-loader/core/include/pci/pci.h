@@ -50,7 +50,11 @@
 #define BL_PCI_CONFIG_REG_VENDOR_ID	0x00
 #define BL_PCI_CONFIG_REG_DEVICE_ID	0x02
 #define BL_PCI_CONFIG_REG_COMMAND	0x04
+# define BL_PCI_COMMAND_IO_SPACE	(1 << 0)
+# define BL_PCI_COMMAND_MEMORY_SPACE	(1 << 1)
+# define BL_PCI_COMMAND_BUS_MASTER	(1 << 2)
 #define BL_PCI_CONFIG_REG_STATUS	0x06
+# define BL_PCI_STATUS_CAPABILITIES_LIST	(1 << 4)
 #define BL_PCI_CONFIG_REG_REVISION_ID	0x08
 #define BL_PCI_CONFIG_REG_CLASS_CODE		0x09
 # define BL_PCI_CONFIG_REG_PROG_IF		0x09
@@ -69,6 +73,8 @@
 #define BL_PCI_CONFIG_REG_BAR4	0x20
 #define BL_PCI_CONFIG_REG_BAR5	0x24
 
+#define BL_PCI_CONFIG_REG_CAPABILITIES	0x34
+
 /* Various. */
 #define BL_PCI_CONFIG_REG_60H	0x60
 
@@ -117,6 +123,21 @@ static inline u32 bl_pci_read_config_long(u8 bus, u8 dev, u8 func, u8 reg)
 	return bl_inl(BL_PCI_CONFIG_DATA);
 }
 
+/* Write PCI configuration address registers */
+static inline void bl_pci_write_config_word(u8 bus, u8 dev, u8 func, u8 reg, u16 v)
+{
+	bl_outl(BL_PCI_MAKE_CONFIG_ADDRESS(bus, dev, func, reg), BL_PCI_CONFIG_ADDRESS);
+
+	bl_outw(v, BL_PCI_CONFIG_DATA + (reg & 2));
+}
+
+static inline void bl_pci_write_config_long(u8 bus, u8 dev, u8 func, u8 reg, u32 v)
+{
+	bl_outl(BL_PCI_MAKE_CONFIG_ADDRESS(bus, dev, func, reg), BL_PCI_CONFIG_ADDRESS);
+
+	bl_outl(v, BL_PCI_CONFIG_DATA);
+}
+
 struct bl_pci_index {
 	u32 bus;
 	u32 dev;
@@ -17,6 +17,8 @@ int bl_command_false(int, char *argv[]);
 int bl_command_last_result(int, char *argv[]);
 int bl_command_pci_list(int, char *argv[]);
 int bl_command_usb_list(int, char *argv[]);
+int bl_command_storage_list(int, char *argv[]);
+int bl_command_fs_stats(int, char *argv[]);
 
 #endif
 
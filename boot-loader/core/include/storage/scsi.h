@@ -0,0 +1,127 @@
+#ifndef BL_SCSI_H
+#define BL_SCSI_H
+
+#include "include/bl-types.h"
+
+/* SCSI Commands. */
+enum {
+	BL_SCSI_COMMAND_SENSE_DATA	= 0x03,
+	BL_SCSI_COMMAND_INQUIRY		= 0x12,
+	BL_SCSI_COMMAND_READ_CAPACITY10	= 0x25,
+	BL_SCSI_COMMAND_READ6		= 0x08,
+	BL_SCSI_COMMAND_READ10		= 0x28,
+	BL_SCSI_COMMAND_READ16		= 0x88,
+	BL_SCSI_COMMAND_READ_CAPACITY16	= 0x9e,
+};
+
+/* SCSI Status. */
+enum {
+	BL_SCSI_STATUS_GOOD		= 0x00,
+	BL_SCSI_STATUS_CHECK_CONDITION	= 0x02,
+};
+
+/* SCSI Inquiry Command. */
+struct bl_scsi_inquiry {
+	__u8	opcode;
+	__u8	lun;
+	__u8	page_code;
+	__u8	reserved0;
+	__u8	allocation_length;
+	__u8	control;
+} __attribute__((packed));
+
+struct bl_scsi_inquiry_data {
+	__u8	device_type;
+	__u8	rmb;
+	__u8	reserved0[2];
+	__u8	additional_length;
+	__u8	reserved1[3];
+	__u8	vendor[8];
+	__u8	product_id[16];
+	__u8	firmware_revision[4];
+} __attribute__((packed));
+
+/* SCSI Request Sense. */
+struct bl_scsi_request_sense {
+	__u8	opcode;
+	__u8	lun;
+	__u8	reserved0[2];
+	__u8	allocation_length;
+	__u8	control;
+} __attribute__((packed));
+
+struct bl_scsi_request_sense_data {
+	__u8	response_code;
+	__u8	obsolete;
+	__u8	flags;
+	__u32	information;
+	__u8	additional_sense_length;
+	__u32	command_specific_information;
+	__u8	additional_sense_code;
+	__u8	additional_sense_code_qualifier;
+	__u8	field_replaceable_unit_code;
+	__u8	sense_key_specific[3];
+	__u8	additional_sense_bytes[0];
+} __attribute__((packed));
+
+/* SCSI Read. */
+struct bl_scsi_read6 {
+	__u8	opcode;
+	__u8	lba[3];
+	__u8	tranfser_length;
+	__u8	control;
+} __attribute__((packed));
+
+struct bl_scsi_read10 {
+	__u8	opcode;
+	__u8	reserved0;
+	__u32	lba;
+	__u8	reserved1;
+	__u16	tranfser_length;
+	__u8	control;
+} __attribute__((packed));
+
+struct bl_scsi_read16 {
+	__u8	opcode;
+	__u8	reserved0;
+	__u64	lba;
+	__u32	tranfser_length;
+	__u8	reserved1;
+	__u8	control;
+} __attribute__((packed));
+
+/* Highest LBA and sector count READ(10) can address. */
+#define BL_SCSI_READ10_MAX_LBA		0xffffffff
+#define BL_SCSI_READ10_MAX_SECTORS	0xffff
+
+/* SCSI Read Capacity. */
+struct bl_scsi_read_capacity10 {
+	__u8	opcode;
+	__u8	lun;
+	__u32	lba;
+	__u16	reserved0;
+	__u8	reserved1;
+	__u8	control;
+} __attribute__((packed));
+
+struct bl_scsi_read_capacity10_data {
+	__u32	lba;
+	__u32	block_size;
+} __attribute__((packed));
+
+struct bl_scsi_read_capacity16 {
+	__u8	opcode;
+	__u8	lun;
+	__u64	lba;
+	__u32	allocation_length;
+	__u8	reserved0;
+	__u8	control;
+} __attribute__((packed));
+
+struct bl_scsi_read_capacity16_data {
+	__u64	lba;
+	__u32	block_size;
+	__u8	unused0[32 - 12];
+} __attribute__((packed));
+
+#endif
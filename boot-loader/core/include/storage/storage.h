@@ -6,22 +6,96 @@
 
 #define BL_STORAGE_SECTOR_SIZE	512
 
+/* Buffers handed to controllers must be aligned to this. */
+#define BL_STORAGE_DMA_ALIGN		4
+
+/* Reusable buffer for misaligned head & tail sectors. */
+#define BL_STORAGE_SCRATCH_SECTORS	8
+
+/* Block cache budget (in sectors) & largest read that goes through it. */
+#define BL_STORAGE_CACHE_BLOCKS		256
+#define BL_STORAGE_CACHE_MAX_SECTORS	16
+
 typedef enum {
 	BL_DISK_CONTROLLER_TYPE_PATA,
 	BL_DISK_CONTROLLER_TYPE_AHCI,
 	BL_DISK_CONTROLLER_TYPE_USB_SCSI,
+	BL_DISK_CONTROLLER_TYPE_USB_UAS,
+	BL_DISK_CONTROLLER_TYPE_NVME,
+	BL_DISK_CONTROLLER_TYPE_VIRTIO_BLK,
+	BL_DISK_CONTROLLER_TYPE_UEFI_BLOCK_IO,
+	BL_DISK_CONTROLLER_TYPE_BIOS_INT13,
+	BL_DISK_CONTROLLER_TYPE_RAM,
 } bl_disk_controller_t;
 
 struct bl_storage_device;
 
+/* Scatter-gather read segment. */
+struct bl_storage_segment {
+	bl_uint64_t lba;
+	bl_uint64_t sectors;
+	bl_uint8_t *buf;
+};
+
+/* Asynchronous read request. */
+typedef enum {
+	BL_STORAGE_REQUEST_QUEUED,
+	BL_STORAGE_REQUEST_ACTIVE,
+	BL_STORAGE_REQUEST_COMPLETE,
+} bl_storage_request_state_t;
+
+struct bl_storage_request;
+
+typedef void (*bl_storage_request_callback_t)(struct bl_storage_request *);
+
+struct bl_storage_request {
+	struct bl_storage_device *disk;
+
+	bl_uint64_t lba;
+	bl_uint64_t sectors;
+	bl_uint8_t *buf;
+
+	bl_storage_request_state_t state;
+	bl_status_t status;
+
+	/* Called once the request completes. */
+	bl_storage_request_callback_t callback;
+	void *context;
+
+	/* Controller private (AHCI command slot, etc.). */
+	bl_uint32_t tag;
+
+	/* Controller private - sectors issued so far, for requests issued in parts. */
+	bl_uint64_t issued;
+
+	struct bl_storage_request *next;
+};
+
 struct bl_disk_controller_functions {
 	bl_disk_controller_t type;
 
 	bl_status_t (*read)(struct bl_storage_device *, bl_uint8_t *,
 		bl_uint64_t, bl_uint64_t);
 
+	/* Optional. Reading segment list - storage core loops over read() if not set. */
+	bl_status_t (*readv)(struct bl_storage_device *, struct bl_storage_segment *, int);
+
+	/*
+	 * Optional. Start a request without waiting for it, and check whether it is
+	 * done (BL_STATUS_DISK_OPERATION_NOT_FINISHED while in progress). Controllers
+	 * without them have their requests executed synchronously by the storage core.
+	 */
+	bl_status_t (*submit)(struct bl_storage_device *, struct bl_storage_request *);
+	bl_status_t (*poll)(struct bl_storage_device *, struct bl_storage_request *);
+
 	/* For disk controllers that are not associated with a device (like USB SCSI). */
 	bl_status_t (*get_info)(struct bl_storage_device *);
+
+	/*
+	 * Optional. Address of a sector for memory backed devices - reads copy
+	 * straight from it, skipping the block cache & bounce buffers.
+	 */
+	bl_uint8_t *(*map)(struct bl_storage_device *, bl_uint64_t);
 };
 
 struct bl_disk_controller {
@@ -29,6 +103,9 @@ struct bl_disk_controller {
 
 	void *data;
 
+	/* Time spent probing for devices, 0 if not measured. */
+	bl_uint64_t probe_us;
+
 	struct bl_disk_controller *next;
 };
 
@@ -49,6 +126,7 @@ struct bl_partition_table_functions {
 typedef enum {
 	BL_STORAGE_TYPE_HARD_DRIVE,
 	BL_STORAGE_TYPE_USB_DRIVE,
+	BL_STORAGE_TYPE_RAM_DISK,
 } bl_storage_t;
 
 struct bl_storage_device {
@@ -64,9 +142,20 @@ struct bl_storage_device {
 	struct bl_disk_controller *controller;
 	void *data;
 
+	/* Asynchronous requests. */
+	int queue_depth;
+	int in_flight;
+	struct bl_storage_request *requests;
+
 	struct bl_storage_device *next;
 };
 
+struct bl_storage_cache_stats {
+	bl_uint64_t hits;
+	bl_uint64_t misses;
+	bl_uint64_t evictions;
+};
+
 struct bl_storage_device *bl_storage_device_get(int);
 struct bl_partition *bl_storage_partition_get(struct bl_storage_device *, int);
 
@@ -77,6 +166,24 @@ void bl_storage_dump_devices(void);
 bl_status_t bl_storage_device_read(struct bl_storage_device *, bl_uint8_t *,
 	bl_uint64_t, bl_size_t, bl_offset_t);
 
+bl_status_t bl_storage_device_readv(struct bl_storage_device *,
+	struct bl_storage_segment *, int);
+
+struct bl_storage_request *bl_storage_request_submit(struct bl_storage_device *,
+	bl_uint8_t *, bl_uint64_t, bl_uint64_t, bl_storage_request_callback_t, void *);
+bl_status_t bl_storage_request_poll(struct bl_storage_request *);
+bl_status_t bl_storage_request_wait(struct bl_storage_request *, bl_uint64_t);
+void bl_storage_request_free(struct bl_storage_request *);
+void bl_storage_device_set_queue_depth(struct bl_storage_device *, int);
+
+bl_status_t bl_storage_cache_read(struct bl_storage_device *, bl_uint8_t *,
+	bl_uint64_t, bl_uint64_t);
+void bl_storage_cache_invalidate(struct bl_storage_device *);
+void bl_storage_cache_get_stats(struct bl_storage_cache_stats *);
+void bl_storage_cache_dump_stats(void);
+
+struct bl_storage_device *bl_ramdisk_create(void *, bl_uint64_t);
+
 void bl_storage_device_register(struct bl_storage_device *);
 void bl_storage_device_unregister(struct bl_storage_device *);
 
@@ -89,6 +196,7 @@ void bl_partition_table_unregister(struct bl_partition_table_functions *);
 
 void bl_disk_controller_register(struct bl_disk_controller *);
 void bl_disk_controller_unregister(struct bl_disk_controller *);
+void bl_disk_controller_dump(void);
 
 #endif
 
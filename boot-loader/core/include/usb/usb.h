@@ -222,6 +222,17 @@ struct bl_usb_endpoint_descriptor {
 	__u8	interval;
 } __attribute__((packed));
 
+/* USB SuperSpeed endpoint companion descriptor. */
+#define BL_USB_SS_COMPANION_MAX_STREAMS(attributes)	(attributes & 0x1f)
+
+struct bl_usb_superspeed_endpoint_companion_descriptor {
+	__u8	length;
+	__u8	descriptor_type;
+	__u8	max_burst;
+	__u8	attributes;
+	__u16	bytes_per_interval;
+} __attribute__((packed));
+
 /* USB string descriptor. */
 struct bl_usb_string_descriptor {
 	__u8	length;
@@ -322,11 +333,19 @@ struct bl_usb_host_controller_functions {
 		int, bl_uint8_t *, int);
 
 	bl_status_t (*check_transfer_status)(bl_usb_transfer_info_t);
+
+	/* Bulk streams, XHCI only. In - streams wanted, out - streams allocated. */
+	bl_status_t (*alloc_streams)(struct bl_usb_host_controller *,
+		int, struct bl_usb_endpoint *, int *);
 };
 
 /* Related to host controller work. */
 struct bl_usb_endpoint {
 	int toggle;
+
+	/* Stream of the next bulk transfer, once streams were allocated. */
+	int stream_id;
+
 	struct bl_usb_endpoint_descriptor *descriptor;
 };
 
@@ -343,6 +362,7 @@ typedef enum {
 
 typedef enum {
 	BL_USB_STORAGE_BBB,
+	BL_USB_STORAGE_UAS,
 } bl_usb_storage_t;
 
 struct bl_usb_device {
@@ -376,6 +396,9 @@ struct bl_usb_device {
 
 			int interface;
 			struct bl_usb_endpoint in_endp, out_endp;
+
+			/* Transport private data. */
+			void *transport;
 		} storage;
 
 		/* HID keyboard. */
@@ -414,6 +437,9 @@ struct bl_usb_host_controller {
 	int bus;
 	int devices_count; // Assign addresses in increasing order.
 
+	/* Packets a single bulk transfer may span - bounded by TD pools. */
+	int max_bulk_packets;
+
 	struct bl_usb_host_controller_functions *funcs;
 	struct bl_usb_hub root_hub;
 	void *data;
@@ -439,6 +465,12 @@ void bl_usb_control_transfer(struct bl_usb_device *, void *,
 
 void bl_usb_bulk_transfer(struct bl_usb_device *, int, void *, int);
 
+void bl_usb_endpoint_bulk_transfer(struct bl_usb_device *, struct bl_usb_endpoint *,
+	void *, int);
+
+bl_status_t bl_usb_endpoint_alloc_streams(struct bl_usb_device *,
+	struct bl_usb_endpoint *, int *);
+
 bl_usb_transfer_info_t bl_usb_interrupt_transfer(struct bl_usb_device *,
 	struct bl_usb_endpoint *, void *, int);
 
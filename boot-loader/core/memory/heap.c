@@ -10,8 +10,9 @@
 #define BL_HEAP_ALIGN_LOG2	4
 #define BL_HEAP_MEM_ALIGN	(1 << BL_HEAP_ALIGN_LOG2)
 
-#ifndef FIRMWARE_BIOS
 extern bl_uint8_t __bl_modules_start[];
+#ifdef FIRMWARE_BIOS
+extern bl_uint8_t __bl_image_start[];
 #endif
 
 struct bl_heap_block_head {
@@ -27,18 +28,20 @@ static bl_int32_t free_blocks = 0;
 
 void bl_heap_init(void)
 {
+	int i;
+	struct bl_module_list_header *mod_list;
+	struct bl_module_header *mod;
+
 	if (bl_heap)
 		return;
 
 #ifdef FIRMWARE_BIOS
-	/* Heap implementation under 1MB is pretty limited .. */
-	bl_heap = (bl_uint8_t *)0x100000;
+	/* Stage 2 left the whole image at 1 MiB, the heap starts past its module list. */
+	mod_list = (struct bl_module_list_header *)(BL_BIOS_IMAGE_ADDRESS +
+		(__bl_modules_start - __bl_image_start));
 #else
-	int i;
-	struct bl_module_list_header *mod_list;
-	struct bl_module_header *mod;
-
 	mod_list = (struct bl_module_list_header *)__bl_modules_start;
+#endif
 	if (mod_list->magic == BL_MODULE_LIST_HEADER_MAGIC) {
 		for (mod = (struct bl_module_header *)(mod_list + 1), i = 0; i < mod_list->count;
 			mod = (struct bl_module_header *)((bl_addr_t)(mod + 1) + mod->size), i++)
@@ -47,8 +50,7 @@ void bl_heap_init(void)
 
 		bl_heap = (void *)BL_MEMORY_ALIGN_UP((bl_addr_t)mod, BL_HEAP_MEM_ALIGN);
 	} else
-		bl_heap = (void *)BL_MEMORY_ALIGN_UP((bl_addr_t)__bl_modules_start, BL_HEAP_MEM_ALIGN);
-#endif
+		bl_heap = (void *)BL_MEMORY_ALIGN_UP((bl_addr_t)mod_list, BL_HEAP_MEM_ALIGN);
 }
 
 static void *__bl_heap_alloc_align(bl_uint8_t ptr[], bl_size_t sz, bl_size_t align)
@@ -17,6 +17,7 @@ bl_status_t bl_partition_table_probe(struct bl_storage_device *disk)
 
 	return BL_STATUS_UNPROPER_DISK;
 }
+BL_EXPORT_FUNC(bl_partition_table_probe);
 
 #if 0
 void bl_partition_table_free_map(struct bl_partition *table)
@@ -10,7 +10,7 @@ struct bl_command_info {
 };
 
 // Keep this list updated
-#define BL_COMMAND_TOTAL	6
+#define BL_COMMAND_TOTAL	8
 
 static struct bl_command_info bl_commands[BL_COMMAND_TOTAL] = {
 	{
@@ -49,13 +49,17 @@ static struct bl_command_info bl_commands[BL_COMMAND_TOTAL] = {
 		.execute = bl_command_usb_list,
 	},
 
-#if 0
 	{
 		.command = "storage-list",
 		.help = "Display attached storage devices.",
-		.execute = bl_shell_usb_list,
+		.execute = bl_command_storage_list,
+	},
+
+	{
+		.command = "fs-stats",
+		.help = "Display cache statistics of mounted file systems.",
+		.execute = bl_command_fs_stats,
 	},
-#endif
 };
 
 /* Should be enough . */
@@ -109,6 +113,6 @@ void bl_command_run(const char *command)
 			return;
 		}
 
-	bl_heap_free(copy_command, len);
+	bl_heap_free(copy_command, len + 1);
 }
 
@@ -0,0 +1,9 @@
+#include "core/include/shell/command.h"
+#include "core/include/fs/fs.h"
+
+int bl_command_fs_stats(int argc, char *argv[])
+{
+	bl_fs_dump_mounts();
+
+	return 0;
+}
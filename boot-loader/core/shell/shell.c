@@ -49,6 +49,7 @@ static void bl_shell_set_disk(int index)
 
 static void bl_shell_set_partition(int index)
 {
+	bl_fs_handle_t handle;
 	struct bl_partition *partition;
 
 	if (operated_disk) {
@@ -57,10 +58,16 @@ static void bl_shell_set_partition(int index)
 
 		partition = bl_storage_partition_get(operated_disk, index);
 		if (partition) {
-			operated_fs_handle = bl_fs_try_mount(operated_disk, partition);
-			if (!operated_fs_handle)
+			handle = bl_fs_try_mount(operated_disk, partition);
+			if (!handle)
 				return;
 
+			/* Previous mount goes, along with its cached dentries. */
+			if (operated_fs_handle)
+				bl_fs_umount(operated_fs_handle);
+
+			operated_fs_handle = handle;
+
 			partition_index = index;
 			operated_partition = partition;
 
@@ -1,9 +1,11 @@
 #include "core/include/shell/command.h"
 #include "core/include/storage/storage.h"
 
-int shell_storage_list(int argc, char *argv[])
+int bl_command_storage_list(int argc, char *argv[])
 {
+	bl_disk_controller_dump();
 	bl_storage_dump_devices();
+	bl_storage_cache_dump_stats();
 
 	return 0;
 }
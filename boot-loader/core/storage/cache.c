@@ -0,0 +1,261 @@
+#include "include/export.h"
+#include "include/string.h"
+#include "core/include/storage/storage.h"
+#include "core/include/video/print.h"
+#include "core/include/memory/heap.h"
+
+/*
+ * Block cache shared by all storage devices. Sectors are keyed on (disk, LBA),
+ * looked up through a small hash table and evicted in LRU order once the
+ * fixed budget of BL_STORAGE_CACHE_BLOCKS sectors is exhausted.
+ */
+
+#define BL_STORAGE_CACHE_HASH_SIZE	64
+
+struct bl_storage_cache_block {
+	struct bl_storage_device *disk;
+	bl_uint64_t lba;
+
+	bl_uint8_t *data;
+
+	/* LRU list - head is most recently used. */
+	struct bl_storage_cache_block *prev;
+	struct bl_storage_cache_block *next;
+
+	/* Hash chain. */
+	struct bl_storage_cache_block *hash_next;
+};
+
+static struct bl_storage_cache_block *bl_cache_blocks = NULL;
+static struct bl_storage_cache_block *bl_cache_hash[BL_STORAGE_CACHE_HASH_SIZE];
+
+static struct bl_storage_cache_block *bl_cache_lru_head = NULL;
+static struct bl_storage_cache_block *bl_cache_lru_tail = NULL;
+
+static struct bl_storage_cache_stats bl_cache_stats = { 0 };
+
+static inline int bl_storage_cache_hash(struct bl_storage_device *disk, bl_uint64_t lba)
+{
+	return ((bl_addr_t)disk ^ (bl_uint32_t)lba) & (BL_STORAGE_CACHE_HASH_SIZE - 1);
+}
+
+static void bl_storage_cache_lru_unlink(struct bl_storage_cache_block *block)
+{
+	if (block->prev)
+		block->prev->next = block->next;
+	else
+		bl_cache_lru_head = block->next;
+
+	if (block->next)
+		block->next->prev = block->prev;
+	else
+		bl_cache_lru_tail = block->prev;
+
+	block->prev = block->next = NULL;
+}
+
+static void bl_storage_cache_lru_push(struct bl_storage_cache_block *block)
+{
+	block->prev = NULL;
+	block->next = bl_cache_lru_head;
+
+	if (bl_cache_lru_head)
+		bl_cache_lru_head->prev = block;
+	else
+		bl_cache_lru_tail = block;
+
+	bl_cache_lru_head = block;
+}
+
+static void bl_storage_cache_hash_remove(struct bl_storage_cache_block *block)
+{
+	struct bl_storage_cache_block **p;
+
+	if (!block->disk)
+		return;
+
+	p = &bl_cache_hash[bl_storage_cache_hash(block->disk, block->lba)];
+	while (*p) {
+		if (*p == block) {
+			*p = block->hash_next;
+			break;
+		}
+
+		p = &(*p)->hash_next;
+	}
+
+	block->hash_next = NULL;
+	block->disk = NULL;
+}
+
+static bl_status_t bl_storage_cache_init(void)
+{
+	int i;
+	bl_uint8_t *data;
+
+	if (bl_cache_blocks)
+		return BL_STATUS_SUCCESS;
+
+	bl_cache_blocks = bl_heap_alloc(BL_STORAGE_CACHE_BLOCKS *
+		sizeof(struct bl_storage_cache_block));
+	if (!bl_cache_blocks)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	data = bl_heap_alloc_align(BL_STORAGE_CACHE_BLOCKS * BL_STORAGE_SECTOR_SIZE,
+		BL_STORAGE_SECTOR_SIZE);
+	if (!data) {
+		bl_heap_free(bl_cache_blocks, BL_STORAGE_CACHE_BLOCKS *
+			sizeof(struct bl_storage_cache_block));
+		bl_cache_blocks = NULL;
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+	}
+
+	bl_memset(bl_cache_hash, 0, sizeof(bl_cache_hash));
+	bl_cache_lru_head = bl_cache_lru_tail = NULL;
+
+	for (i = 0; i < BL_STORAGE_CACHE_BLOCKS; i++) {
+		bl_cache_blocks[i].disk = NULL;
+		bl_cache_blocks[i].lba = 0;
+		bl_cache_blocks[i].data = data + i * BL_STORAGE_SECTOR_SIZE;
+		bl_cache_blocks[i].hash_next = NULL;
+
+		/* Unused blocks are taken first. */
+		bl_storage_cache_lru_push(&bl_cache_blocks[i]);
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+static struct bl_storage_cache_block *bl_storage_cache_lookup(struct bl_storage_device *disk,
+	bl_uint64_t lba)
+{
+	struct bl_storage_cache_block *block;
+
+	block = bl_cache_hash[bl_storage_cache_hash(disk, lba)];
+	while (block) {
+		if (block->disk == disk && block->lba == lba)
+			return block;
+
+		block = block->hash_next;
+	}
+
+	return NULL;
+}
+
+static void bl_storage_cache_insert(struct bl_storage_device *disk, bl_uint64_t lba,
+	const bl_uint8_t *data)
+{
+	int hash;
+	struct bl_storage_cache_block *block;
+
+	/* Reuse least recently used block. */
+	block = bl_cache_lru_tail;
+	if (block->disk)
+		bl_cache_stats.evictions++;
+
+	bl_storage_cache_hash_remove(block);
+	bl_storage_cache_lru_unlink(block);
+
+	block->disk = disk;
+	block->lba = lba;
+	bl_memcpy(block->data, data, BL_STORAGE_SECTOR_SIZE);
+
+	hash = bl_storage_cache_hash(disk, lba);
+	block->hash_next = bl_cache_hash[hash];
+	bl_cache_hash[hash] = block;
+
+	bl_storage_cache_lru_push(block);
+}
+
+bl_status_t bl_storage_cache_read(struct bl_storage_device *disk, bl_uint8_t *buf,
+	bl_uint64_t lba, bl_uint64_t sectors)
+{
+	bl_status_t status;
+	bl_uint64_t i, j, k;
+	struct bl_storage_cache_block *block;
+
+	/* Bulk data would only flush metadata out of the cache. */
+	if (sectors > BL_STORAGE_CACHE_MAX_SECTORS || bl_storage_cache_init())
+		return disk->controller->funcs->read(disk, buf, lba, sectors);
+
+	for (i = 0; i < sectors; ) {
+		block = bl_storage_cache_lookup(disk, lba + i);
+		if (block) {
+			bl_cache_stats.hits++;
+
+			bl_memcpy(buf + i * BL_STORAGE_SECTOR_SIZE, block->data,
+				BL_STORAGE_SECTOR_SIZE);
+
+			bl_storage_cache_lru_unlink(block);
+			bl_storage_cache_lru_push(block);
+
+			i++;
+			continue;
+		}
+
+		/* Read the whole run of missing sectors at once. */
+		for (j = i + 1; j < sectors; j++)
+			if (bl_storage_cache_lookup(disk, lba + j))
+				break;
+
+		bl_cache_stats.misses += j - i;
+
+		status = disk->controller->funcs->read(disk, buf + i * BL_STORAGE_SECTOR_SIZE,
+			lba + i, j - i);
+		if (status)
+			return status;
+
+		for (k = i; k < j; k++)
+			bl_storage_cache_insert(disk, lba + k, buf + k * BL_STORAGE_SECTOR_SIZE);
+
+		i = j;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+void bl_storage_cache_invalidate(struct bl_storage_device *disk)
+{
+	int i;
+
+	if (!bl_cache_blocks)
+		return;
+
+	for (i = 0; i < BL_STORAGE_CACHE_BLOCKS; i++)
+		if (bl_cache_blocks[i].disk && (!disk || bl_cache_blocks[i].disk == disk)) {
+			bl_storage_cache_hash_remove(&bl_cache_blocks[i]);
+
+			/* Make it the next victim. */
+			bl_storage_cache_lru_unlink(&bl_cache_blocks[i]);
+			if (bl_cache_lru_tail) {
+				bl_cache_lru_tail->next = &bl_cache_blocks[i];
+				bl_cache_blocks[i].prev = bl_cache_lru_tail;
+				bl_cache_lru_tail = &bl_cache_blocks[i];
+			} else
+				bl_storage_cache_lru_push(&bl_cache_blocks[i]);
+		}
+}
+BL_EXPORT_FUNC(bl_storage_cache_invalidate);
+
+void bl_storage_cache_get_stats(struct bl_storage_cache_stats *stats)
+{
+	*stats = bl_cache_stats;
+}
+BL_EXPORT_FUNC(bl_storage_cache_get_stats);
+
+void bl_storage_cache_dump_stats(void)
+{
+	bl_print_str("Block cache: ");
+
+	bl_print_str("Hits: ");
+	bl_print_decimal64(bl_cache_stats.hits);
+	bl_print_str(" ");
+
+	bl_print_str("Misses: ");
+	bl_print_decimal64(bl_cache_stats.misses);
+	bl_print_str(" ");
+
+	bl_print_str("Evictions: ");
+	bl_print_decimal64(bl_cache_stats.evictions);
+	bl_print_str("\n");
+}
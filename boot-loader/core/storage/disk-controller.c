@@ -2,9 +2,22 @@
 #include "include/string.h"
 #include "core/include/storage/storage.h"
 #include "core/include/memory/heap.h"
+#include "core/include/video/print.h"
 
 static struct bl_disk_controller *controller_list = NULL;
 
+static const char *controller_names[] = {
+	[BL_DISK_CONTROLLER_TYPE_PATA] = "PATA",
+	[BL_DISK_CONTROLLER_TYPE_AHCI] = "AHCI",
+	[BL_DISK_CONTROLLER_TYPE_USB_SCSI] = "USB SCSI",
+	[BL_DISK_CONTROLLER_TYPE_USB_UAS] = "USB UAS",
+	[BL_DISK_CONTROLLER_TYPE_NVME] = "NVMe",
+	[BL_DISK_CONTROLLER_TYPE_VIRTIO_BLK] = "virtio-blk",
+	[BL_DISK_CONTROLLER_TYPE_UEFI_BLOCK_IO] = "UEFI Block I/O",
+	[BL_DISK_CONTROLLER_TYPE_BIOS_INT13] = "BIOS int 13h",
+	[BL_DISK_CONTROLLER_TYPE_RAM] = "RAM",
+};
+
 struct bl_disk_controller *
 bl_disk_controller_match_type(bl_disk_controller_t type)
 {
@@ -35,3 +48,22 @@ void bl_disk_controller_unregister(struct bl_disk_controller *controller)
 }
 BL_EXPORT_FUNC(bl_disk_controller_unregister);
 
+void bl_disk_controller_dump(void)
+{
+	struct bl_disk_controller *curr;
+
+	curr = controller_list;
+	while (curr) {
+		bl_print_str("Controller: ");
+		bl_print_str(controller_names[curr->funcs->type]);
+
+		if (curr->probe_us) {
+			bl_print_str(" Probe time (us): ");
+			bl_print_decimal64(curr->probe_us);
+		}
+
+		bl_print_str("\n");
+
+		curr = curr->next;
+	}
+}
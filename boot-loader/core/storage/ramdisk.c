@@ -0,0 +1,82 @@
+#include "include/export.h"
+#include "include/string.h"
+#include "core/include/storage/storage.h"
+#include "core/include/memory/heap.h"
+
+/*
+ * Disks backed by a memory region (an image loaded by firmware, read from a
+ * file system, etc.). Sectors are copied straight out of the region.
+ */
+
+static struct bl_disk_controller *bl_ramdisk_controller = NULL;
+
+/* The disk data is the base of the region. */
+static bl_uint8_t *bl_ramdisk_map(struct bl_storage_device *disk, bl_uint64_t lba)
+{
+	return (bl_uint8_t *)disk->data + lba * BL_STORAGE_SECTOR_SIZE;
+}
+
+static bl_status_t bl_ramdisk_read(struct bl_storage_device *disk, bl_uint8_t *buf,
+	bl_uint64_t lba, bl_uint64_t sectors)
+{
+	if (lba + sectors > disk->sector_count)
+		return BL_STATUS_INVALID_PARAMETERS;
+
+	bl_memcpy(buf, bl_ramdisk_map(disk, lba), sectors * BL_STORAGE_SECTOR_SIZE);
+
+	return BL_STATUS_SUCCESS;
+}
+
+static struct bl_disk_controller_functions ramdisk_functions = {
+	.type = BL_DISK_CONTROLLER_TYPE_RAM,
+	.read = bl_ramdisk_read,
+	.readv = NULL,
+	.submit = NULL,
+	.poll = NULL,
+	.get_info = NULL,
+	.map = bl_ramdisk_map,
+};
+
+/*
+ * The region has to stay valid for as long as the disk is registered. Disks
+ * created after bl_storage_probe() have to be probed for partitions by the caller.
+ */
+struct bl_storage_device *bl_ramdisk_create(void *base, bl_uint64_t size)
+{
+	struct bl_storage_device *disk;
+
+	if (size < BL_STORAGE_SECTOR_SIZE)
+		return NULL;
+
+	if (!bl_ramdisk_controller) {
+		bl_ramdisk_controller = bl_heap_alloc(sizeof(struct bl_disk_controller));
+		if (!bl_ramdisk_controller)
+			return NULL;
+
+		bl_ramdisk_controller->funcs = &ramdisk_functions;
+		bl_ramdisk_controller->data = NULL;
+		bl_ramdisk_controller->probe_us = 0;
+		bl_ramdisk_controller->next = NULL;
+
+		bl_disk_controller_register(bl_ramdisk_controller);
+	}
+
+	disk = bl_heap_alloc(sizeof(struct bl_storage_device));
+	if (!disk)
+		return NULL;
+
+	disk->type = BL_STORAGE_TYPE_RAM_DISK;
+	disk->product = NULL;
+	disk->serial_number = NULL;
+	disk->sector_size = BL_STORAGE_SECTOR_SIZE;
+	disk->sector_count = size / BL_STORAGE_SECTOR_SIZE;
+	disk->partitions = NULL;
+	disk->controller = bl_ramdisk_controller;
+	disk->data = base;
+	disk->next = NULL;
+
+	bl_storage_device_register(disk);
+
+	return disk;
+}
+BL_EXPORT_FUNC(bl_ramdisk_create);
@@ -0,0 +1,185 @@
+#include "include/export.h"
+#include "include/time.h"
+#include "core/include/storage/storage.h"
+#include "core/include/memory/heap.h"
+
+/*
+ * Asynchronous read requests. Every device keeps a FIFO of its requests, at
+ * most queue_depth of them are handed to the controller at once and the rest
+ * wait to be started as earlier ones complete. There are no interrupts, so
+ * requests only make progress while someone polls or waits on them.
+ */
+
+static void bl_storage_request_unlink(struct bl_storage_request *request)
+{
+	struct bl_storage_request **p;
+
+	p = &request->disk->requests;
+	while (*p) {
+		if (*p == request) {
+			*p = request->next;
+			break;
+		}
+
+		p = &(*p)->next;
+	}
+
+	request->next = NULL;
+}
+
+static void bl_storage_request_complete(struct bl_storage_request *request,
+	bl_status_t status)
+{
+	bl_storage_request_unlink(request);
+
+	request->status = status;
+	request->state = BL_STORAGE_REQUEST_COMPLETE;
+
+	if (request->callback)
+		request->callback(request);
+}
+
+static bl_status_t bl_storage_request_start(struct bl_storage_request *request)
+{
+	bl_status_t status;
+	struct bl_storage_device *disk;
+
+	disk = request->disk;
+
+	/* Controller can't do it in the background - just read. */
+	if (!disk->controller->funcs->submit) {
+		status = disk->controller->funcs->read(disk, request->buf, request->lba,
+			request->sectors);
+		bl_storage_request_complete(request, status);
+		return BL_STATUS_SUCCESS;
+	}
+
+	status = disk->controller->funcs->submit(disk, request);
+
+	/* Controller is busy with earlier requests - retry once they complete. */
+	if (status == BL_STATUS_INSUFFICIENT_RESOURCES && disk->in_flight)
+		return status;
+
+	if (status) {
+		bl_storage_request_complete(request, status);
+		return BL_STATUS_SUCCESS;
+	}
+
+	request->state = BL_STORAGE_REQUEST_ACTIVE;
+	disk->in_flight++;
+
+	return BL_STATUS_SUCCESS;
+}
+
+static void bl_storage_device_progress(struct bl_storage_device *disk)
+{
+	bl_status_t status;
+	struct bl_storage_request *request, *next;
+
+	/* Reap finished requests. */
+	for (request = disk->requests; request; request = next) {
+		next = request->next;
+
+		if (request->state != BL_STORAGE_REQUEST_ACTIVE)
+			continue;
+
+		status = disk->controller->funcs->poll(disk, request);
+		if (status == BL_STATUS_DISK_OPERATION_NOT_FINISHED)
+			continue;
+
+		disk->in_flight--;
+		bl_storage_request_complete(request, status);
+	}
+
+	/* Start queued ones. */
+	for (request = disk->requests; request; request = next) {
+		next = request->next;
+
+		if (disk->in_flight >= disk->queue_depth)
+			break;
+
+		if (request->state == BL_STORAGE_REQUEST_QUEUED)
+			if (bl_storage_request_start(request))
+				break;
+	}
+}
+
+struct bl_storage_request *bl_storage_request_submit(struct bl_storage_device *disk,
+	bl_uint8_t *buf, bl_uint64_t lba, bl_uint64_t sectors,
+	bl_storage_request_callback_t callback, void *context)
+{
+	struct bl_storage_request *request, **p;
+
+	if ((bl_addr_t)buf & (BL_STORAGE_DMA_ALIGN - 1))
+		return NULL;
+
+	request = bl_heap_alloc(sizeof(struct bl_storage_request));
+	if (!request)
+		return NULL;
+
+	request->disk = disk;
+	request->lba = lba;
+	request->sectors = sectors;
+	request->buf = buf;
+	request->state = BL_STORAGE_REQUEST_QUEUED;
+	request->status = BL_STATUS_DISK_OPERATION_NOT_FINISHED;
+	request->callback = callback;
+	request->context = context;
+	request->tag = 0;
+	request->issued = 0;
+	request->next = NULL;
+
+	/* Keep submission order. */
+	p = &disk->requests;
+	while (*p)
+		p = &(*p)->next;
+	*p = request;
+
+	bl_storage_device_progress(disk);
+
+	return request;
+}
+BL_EXPORT_FUNC(bl_storage_request_submit);
+
+bl_status_t bl_storage_request_poll(struct bl_storage_request *request)
+{
+	if (request->state != BL_STORAGE_REQUEST_COMPLETE)
+		bl_storage_device_progress(request->disk);
+
+	if (request->state != BL_STORAGE_REQUEST_COMPLETE)
+		return BL_STATUS_DISK_OPERATION_NOT_FINISHED;
+
+	return request->status;
+}
+BL_EXPORT_FUNC(bl_storage_request_poll);
+
+bl_status_t bl_storage_request_wait(struct bl_storage_request *request, bl_uint64_t timeout)
+{
+	bl_status_t status;
+
+	if (!bl_poll_until((status = bl_storage_request_poll(request)) !=
+				BL_STATUS_DISK_OPERATION_NOT_FINISHED, timeout * 1000))
+		return BL_STATUS_DISK_OPERATION_TIMEOUT;
+
+	return status;
+}
+BL_EXPORT_FUNC(bl_storage_request_wait);
+
+void bl_storage_request_free(struct bl_storage_request *request)
+{
+	/* The controller may still write into the buffer. */
+	if (request->state == BL_STORAGE_REQUEST_ACTIVE)
+		return;
+
+	if (request->state == BL_STORAGE_REQUEST_QUEUED)
+		bl_storage_request_unlink(request);
+
+	bl_heap_free(request, sizeof(struct bl_storage_request));
+}
+BL_EXPORT_FUNC(bl_storage_request_free);
+
+void bl_storage_device_set_queue_depth(struct bl_storage_device *disk, int depth)
+{
+	disk->queue_depth = depth > 0 ? depth : 1;
+}
+BL_EXPORT_FUNC(bl_storage_device_set_queue_depth);
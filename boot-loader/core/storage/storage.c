@@ -1,5 +1,6 @@
 #include "include/export.h"
 #include "include/string.h"
+#include "include/bl-utils.h"
 #include "core/include/storage/storage.h"
 #include "core/include/video/print.h"
 #include "core/include/memory/heap.h"
@@ -20,6 +21,7 @@ struct bl_storage_device *bl_storage_device_get(int index)
 
 	return NULL;
 }
+BL_EXPORT_FUNC(bl_storage_device_get);
 
 struct bl_partition *bl_storage_partition_get(struct bl_storage_device *disk, int index)
 {
@@ -36,6 +38,32 @@ struct bl_partition *bl_storage_partition_get(struct bl_storage_device *disk, in
 	return NULL;
 }
 
+/* USB disks come without a controller, take the first transport that accepts them. */
+static bl_status_t bl_storage_usb_attach(struct bl_storage_device *disk)
+{
+	int i;
+	struct bl_disk_controller *controller;
+	static const bl_disk_controller_t types[] = {
+		BL_DISK_CONTROLLER_TYPE_USB_UAS,
+		BL_DISK_CONTROLLER_TYPE_USB_SCSI,
+	};
+
+	for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		controller = bl_disk_controller_match_type(types[i]);
+		if (!controller)
+			continue;
+
+		disk->controller = controller;
+
+		if (!controller->funcs->get_info || !controller->funcs->get_info(disk))
+			return BL_STATUS_SUCCESS;
+	}
+
+	disk->controller = NULL;
+
+	return BL_STATUS_USB_INVALID_DEVICE;
+}
+
 bl_status_t bl_storage_probe(void)
 {
 	bl_status_t status;
@@ -44,15 +72,11 @@ bl_status_t bl_storage_probe(void)
 	disk = bl_storage_devices;
 	while (disk) {
 		if (!disk->controller) {
-			struct bl_disk_controller *controller =
-				bl_disk_controller_match_type(BL_DISK_CONTROLLER_TYPE_USB_SCSI);
-			if (!controller)
+			if (bl_storage_usb_attach(disk)) {
+				disk = disk->next;
 				continue;
-
-			disk->controller = controller;
-		}
-
-		if (disk->controller->funcs->get_info) {
+			}
+		} else if (disk->controller->funcs->get_info) {
 			status = disk->controller->funcs->get_info(disk);
 			if (status)
 				return status;
@@ -92,6 +116,10 @@ void bl_storage_dump_devices(void)
 
 void bl_storage_device_register(struct bl_storage_device *disk)
 {
+	disk->queue_depth = 1;
+	disk->in_flight = 0;
+	disk->requests = NULL;
+
 	disk->next = bl_storage_devices;
 	bl_storage_devices = disk;
 }
@@ -99,46 +127,123 @@ BL_EXPORT_FUNC(bl_storage_device_register);
 
 void bl_storage_device_unregister(struct bl_storage_device *disk)
 {
-
+	bl_storage_cache_invalidate(disk);
 }
 BL_EXPORT_FUNC(bl_storage_device_unregister);
 
+static bl_uint8_t *bl_storage_scratch = NULL;
+
+static bl_status_t bl_storage_device_read_bounced(struct bl_storage_device *disk,
+	bl_uint8_t *buf, bl_uint64_t lba, bl_size_t size, bl_offset_t offset)
+{
+	bl_status_t status;
+	bl_size_t sectors, count;
+
+	if (!bl_storage_scratch) {
+		bl_storage_scratch = bl_heap_alloc_align(BL_STORAGE_SCRATCH_SECTORS *
+			BL_STORAGE_SECTOR_SIZE, BL_STORAGE_DMA_ALIGN);
+		if (!bl_storage_scratch)
+			return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+	}
+
+	while (size) {
+		sectors = BL_MEMORY_ALIGN_UP(offset + size, BL_STORAGE_SECTOR_SIZE) /
+			BL_STORAGE_SECTOR_SIZE;
+		sectors = BL_MIN(sectors, BL_STORAGE_SCRATCH_SECTORS);
+
+		status = bl_storage_cache_read(disk, bl_storage_scratch, lba, sectors);
+		if (status)
+			return status;
+
+		count = BL_MIN(size, sectors * BL_STORAGE_SECTOR_SIZE - offset);
+		bl_memcpy(buf, bl_storage_scratch + offset, count);
+
+		buf += count;
+		size -= count;
+		lba += sectors;
+		offset = 0;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
 bl_status_t bl_storage_device_read(struct bl_storage_device *disk, bl_uint8_t *buf,
 	bl_uint64_t lba, bl_size_t size, bl_offset_t offset)
 {
 	bl_status_t status;
-	bl_uint8_t *raw_disk_data;
-	bl_size_t sectors_size;
+	bl_size_t head, sectors;
 
-	sectors_size = BL_MEMORY_ALIGN_UP(offset + size, BL_STORAGE_SECTOR_SIZE);
+	lba += offset / BL_STORAGE_SECTOR_SIZE;
+	offset %= BL_STORAGE_SECTOR_SIZE;
 
-	//if (offset && ((offset + size) & (BL_STORAGE_SECTOR_SIZE - 1))) {
-		raw_disk_data = bl_heap_alloc(sectors_size);
-		if (!raw_disk_data) {
-			status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
-			goto _exit;
-		}
+	/* Memory backed - any alignment, nothing worth caching. */
+	if (disk->controller->funcs->map) {
+		if (lba > disk->sector_count || BL_MEMORY_ALIGN_UP(offset + size,
+				BL_STORAGE_SECTOR_SIZE) / BL_STORAGE_SECTOR_SIZE > disk->sector_count - lba)
+			return BL_STATUS_INVALID_PARAMETERS;
+
+		bl_memcpy(buf, disk->controller->funcs->map(disk, lba) + offset, size);
 
-		status = disk->controller->funcs->read(disk, raw_disk_data, lba,
-			sectors_size / BL_STORAGE_SECTOR_SIZE);
+		return BL_STATUS_SUCCESS;
+	}
+
+	/* Controllers can't DMA into every address. */
+	if ((bl_addr_t)buf & (BL_STORAGE_DMA_ALIGN - 1))
+		return bl_storage_device_read_bounced(disk, buf, lba, size, offset);
+
+	/* Misaligned head sector. */
+	if (offset) {
+		head = BL_MIN(size, BL_STORAGE_SECTOR_SIZE - offset);
+
+		status = bl_storage_device_read_bounced(disk, buf, lba, head, offset);
 		if (status)
-			goto _exit;
+			return status;
 
-		bl_memcpy(buf, raw_disk_data + offset, size);
-	/*} else {
-		raw_disk_data = NULL;
+		buf += head;
+		size -= head;
+		lba++;
+	}
 
-		status = disk->controller->funcs->read(disk, buf, lba, sectors_size /
-			BL_STORAGE_SECTOR_SIZE);
+	/* Whole sectors go straight into the caller's buffer. */
+	sectors = size / BL_STORAGE_SECTOR_SIZE;
+	if (sectors) {
+		status = bl_storage_cache_read(disk, buf, lba, sectors);
 		if (status)
-			goto _exit;
-	}*/
+			return status;
+
+		buf += sectors * BL_STORAGE_SECTOR_SIZE;
+		size -= sectors * BL_STORAGE_SECTOR_SIZE;
+		lba += sectors;
+	}
 
-_exit:
-	if (raw_disk_data)
-		bl_heap_free(raw_disk_data, sectors_size);
+	/* Misaligned tail sector. */
+	if (size)
+		return bl_storage_device_read_bounced(disk, buf, lba, size, 0);
 
-	return status;
+	return BL_STATUS_SUCCESS;
 }
 BL_EXPORT_FUNC(bl_storage_device_read);
 
+bl_status_t bl_storage_device_readv(struct bl_storage_device *disk,
+	struct bl_storage_segment *segments, int count)
+{
+	int i;
+	bl_status_t status;
+
+	for (i = 0; i < count; i++)
+		if ((bl_addr_t)segments[i].buf & (BL_STORAGE_DMA_ALIGN - 1))
+			return BL_STATUS_INVALID_PARAMETERS;
+
+	if (disk->controller->funcs->readv)
+		return disk->controller->funcs->readv(disk, segments, count);
+
+	for (i = 0; i < count; i++) {
+		status = disk->controller->funcs->read(disk, segments[i].buf,
+			segments[i].lba, segments[i].sectors);
+		if (status)
+			return status;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+BL_EXPORT_FUNC(bl_storage_device_readv);
@@ -0,0 +1,39 @@
+#include "include/bl-utils.h"
+#include "include/export.h"
+
+/* CRC-32 (IEEE 802.3, reflected) as used by GPT. */
+#define BL_CRC32_POLYNOMIAL	0xedb88320
+
+static bl_uint32_t bl_crc32_table[256];
+static int bl_crc32_table_ready = 0;
+
+static void bl_crc32_init_table(void)
+{
+	int i, j;
+	bl_uint32_t c;
+
+	for (i = 0; i < 256; i++) {
+		for (c = i, j = 0; j < 8; j++)
+			c = (c & 1) ? (c >> 1) ^ BL_CRC32_POLYNOMIAL : c >> 1;
+
+		bl_crc32_table[i] = c;
+	}
+
+	bl_crc32_table_ready = 1;
+}
+
+/* Continue a CRC over more data, start with 0. */
+bl_uint32_t bl_crc32(bl_uint32_t crc, const void *buf, bl_size_t len)
+{
+	const bl_uint8_t *p = buf;
+
+	if (!bl_crc32_table_ready)
+		bl_crc32_init_table();
+
+	crc = ~crc;
+	while (len--)
+		crc = bl_crc32_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+BL_EXPORT_FUNC(bl_crc32);
@@ -229,16 +229,18 @@ char *bl_strndup(const char *s, bl_size_t n)
 	if (!s)
 		return NULL;
 
-	len = bl_strlen(s) + 1;
+	len = bl_strlen(s);
 	if (len > n)
-		len = n + 1;
+		len = n;
 
-	res = bl_heap_alloc(len);
+	res = bl_heap_alloc(len + 1);
 	if (!res)
 		return NULL;
 
+	bl_memcpy(res, s, len);
 	res[len] = 0;
-	return bl_memcpy(res, s, len);
+
+	return res;
 }
 BL_EXPORT_FUNC(bl_strndup);
 
@@ -284,10 +286,13 @@ char *bl_strtok(char *s, const char *delim)
 	while (*end != '\0' && !bl_isdelim(*end, delim))
 		end++;
 
-	*end = '\0';
-
 	res = bl_strtok_str;
-	bl_strtok_str = end + 1;
+
+	/* Don't step past the terminating null byte. */
+	if (*end != '\0')
+		*end++ = '\0';
+
+	bl_strtok_str = end;
 
 	return res;
 }
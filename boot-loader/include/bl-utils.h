@@ -1,6 +1,7 @@
 #ifndef BL_UTILS_H
 #define BL_UTILS_H
 
+#include "include/bl-types.h"
 #include "include/utils.h"
 
 #define BL_MIN	MIN
@@ -8,6 +9,7 @@
 
 int bl_log2(unsigned);
 void bl_divmod64(bl_uint64_t, bl_uint64_t, bl_uint64_t *, bl_uint64_t *);
+bl_uint32_t bl_crc32(bl_uint32_t, const void *, bl_size_t);
 
 #endif
 
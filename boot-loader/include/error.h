@@ -28,9 +28,11 @@ typedef enum {
 	BL_STATUS_INVALID_FILE_SYSTEM,
 	BL_STATUS_FILE_NOT_FOUND,
 	BL_STATUS_FILE_SYSTEM_ERROR,
+	BL_STATUS_FILE_SYSTEM_BUSY,
 
 	// Various disk errors.
 	BL_STATUS_DISK_OPERATION_TIMEOUT,
+	BL_STATUS_DISK_OPERATION_NOT_FINISHED,
 	BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR,
 	BL_STATUS_UNPROPER_DISK,
 	BL_STATUS_UNBOOTABLE_DISK,
@@ -40,6 +40,12 @@ static inline u32 bl_inl(u16 port)
 	return v;
 }
 
+/* String port I/O */
+static inline void bl_insw(u16 port, void *buf, u32 count)
+{
+	asm volatile("rep insw" : "+D" (buf), "+c" (count) : "d" (port) : "memory");
+}
+
 /* Delay port I/O, usually takes 1ms to complete */
 static inline void bl_io_delay(void)
 {
@@ -5,6 +5,35 @@
 
 void bl_time_setup(void);
 bl_uint64_t bl_time_sleep(bl_uint64_t);
+void bl_time_udelay(bl_uint64_t);
+
+/* Microsecond deadlines, based on the time stamp counter. */
+bl_uint64_t bl_time_deadline(bl_uint64_t);
+int bl_time_deadline_expired(bl_uint64_t);
+
+/* Measuring - take a stamp, later get the microseconds passed since. */
+bl_uint64_t bl_time_stamp(void);
+bl_uint64_t bl_time_elapsed_us(bl_uint64_t);
+
+/*
+ * Busy wait until the condition holds or timeout (microseconds) passes. The
+ * condition is checked once more after the deadline, so a late completion is
+ * not reported as a timeout. Evaluates to non zero if the condition holds.
+ */
+#define bl_poll_until(condition, timeout_us)					\
+	({									\
+		int __done;							\
+		bl_uint64_t __deadline = bl_time_deadline(timeout_us);		\
+										\
+		while (!(__done = !!(condition)) &&				\
+				!bl_time_deadline_expired(__deadline))		\
+			;							\
+										\
+		if (!__done)							\
+			__done = !!(condition);					\
+										\
+		__done;								\
+	})
 
 #endif
 
@@ -272,55 +272,60 @@ static bl_status_t bl_ext_open(bl_fs_handle_t handle, const char *path, bl_file_
 	struct bl_file_tree_node *root;
 	struct bl_ext_inode *inode;
 	struct bl_ext_info *info;
-	bl_file_data_t *fdata;
+	struct bl_dentry *dentry;
 	bl_file_t _file;
 
-	/* Prepare root node. */
-	root = bl_heap_alloc(sizeof(struct bl_file_tree_node));
-	if (!root) {
-		status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
-		goto _exit;
-	}
+	/* Prepare root node, until the mount caches one. */
+	root = NULL;
+	if (!handle->dcache.root) {
+		root = bl_heap_alloc(sizeof(struct bl_file_tree_node));
+		if (!root) {
+			status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
+			goto _exit;
+		}
 
-	root->fdata = NULL;
-	root->prev = NULL;
+		root->fdata = NULL;
+		root->prev = NULL;
 
-	root->fdata = bl_heap_alloc(sizeof(struct bl_ext_file_data));
-	if (!root->fdata) {
-		status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
-		goto _exit;
-	}
+		root->fdata = bl_heap_alloc(sizeof(struct bl_ext_file_data));
+		if (!root->fdata) {
+			status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
+			goto _exit;
+		}
 
-	info = handle->info;
-	((struct bl_ext_file_data *)root->fdata)->info = info;
+		info = handle->info;
+		((struct bl_ext_file_data *)root->fdata)->info = info;
 
-	inode = bl_heap_alloc(sizeof(struct bl_ext_inode));
-	if (!inode) {
-		status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
-		goto _exit;
-	}
+		inode = bl_heap_alloc(sizeof(struct bl_ext_inode));
+		if (!inode) {
+			status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
+			goto _exit;
+		}
 
-	status = bl_ext_get_inode(info, 2, inode);
-	if (status)
-		return status;
+		status = bl_ext_get_inode(info, 2, inode);
+		if (status)
+			return status;
 
-	((struct bl_ext_file_data *)root->fdata)->inode = inode;;
+		((struct bl_ext_file_data *)root->fdata)->inode = inode;;
+	}
 
 	/* Iterate EXT. */
-	status = bl_file_iterate_path(handle->fs, path, root, &bl_ext_iterate_directory_callback,
-			&fdata);
+	status = bl_file_iterate_path(handle, path, root, &bl_ext_iterate_directory_callback,
+			&dentry);
 	if (status)
 		goto _exit;
 
 	/* Return file handle. */
 	_file = bl_heap_alloc(sizeof(*_file));
 	if (!_file) {
+		bl_dcache_put(handle, dentry);
 		status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
 		goto _exit;
 	}
 
 	_file->handle = handle;
-	_file->fdata = fdata;
+	_file->fdata = dentry->fdata;
+	_file->dentry = dentry;
 
 	*file = _file;
 	_file = NULL;
@@ -329,8 +334,23 @@ _exit:
 	return status;
 }
 
+static bl_size_t bl_ext_fdata_size(bl_file_data_t somedata)
+{
+	return sizeof(struct bl_ext_file_data) + sizeof(struct bl_ext_inode);
+}
+
 static bl_status_t bl_ext_close(bl_file_data_t somedata)
 {
+	struct bl_ext_file_data *fdata;
+
+	if (!somedata)
+		return BL_STATUS_INVALID_PARAMETERS;
+
+	fdata = somedata;
+
+	bl_heap_free(fdata->inode, sizeof(struct bl_ext_inode));
+	bl_heap_free(fdata, sizeof(struct bl_ext_file_data));
+
 	return BL_STATUS_SUCCESS;
 }
 
@@ -420,6 +440,7 @@ static struct bl_fs ext_fs = {
 	.mount = bl_ext_mount,
 	.open = bl_ext_open,
 	.close = bl_ext_close,
+	.fdata_size = bl_ext_fdata_size,
 };
 
 BL_MODULE_INIT()
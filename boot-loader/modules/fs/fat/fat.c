@@ -7,9 +7,21 @@
 #include "core/include/storage/storage.h"
 #include "core/include/fs/fs.h"
 #include "core/include/memory/heap.h"
+#include "core/include/video/print.h"
 
 BL_MODULE_NAME("File Allocation Table (12/16/32)");
 
+/* Part of the FAT held in memory, `sector' is relative to the first FAT sector. */
+struct bl_fat_cache_window {
+	bl_uint32_t sector;
+	bl_uint32_t stamp;
+};
+
+struct bl_fat_cache_stats {
+	bl_uint64_t hits;
+	bl_uint64_t misses;
+};
+
 /* Observation of whole FAT. */
 struct bl_fat_info {
 	int fat_type;
@@ -26,24 +38,40 @@ struct bl_fat_info {
 	bl_uint64_t fat_lba;
 	bl_uint64_t sectors_per_fat;
 
-	/* Good with FAT16 & FAT32. With FAT12 entries are overlapped
-	   (within sectors) so add one or two bytes for allocation. */
-	void *fat_cache;
+	/* Whole FAT when small enough (always with FAT12 & FAT16), LRU windows otherwise. */
+	bl_uint8_t *fat_cache;
 	bl_uint32_t fat_cache_size;
-	bl_uint32_t fat_cache_sector;
+	bl_uint32_t fat_cache_window_sectors;
+	int fat_cache_windows;
+	bl_uint32_t fat_cache_clock;
+	struct bl_fat_cache_window fat_cache_window[BL_FAT_CACHE_WINDOWS];
+	struct bl_fat_cache_stats fat_cache_stats;
 
 	bl_uint64_t rootdir_lba;
 	bl_uint16_t rootdir_entries;
+	bl_uint32_t rootdir_cluster;
 
 	bl_uint64_t data_lba;
 };
 
 #define BL_FAT_SECTORS_PER_CLUSTER(info)	(info->cluster_size / info->sector_size)
 
+/* Run of consecutive clusters, `file_cluster' is its index within the file. */
+struct bl_fat_extent {
+	bl_uint32_t cluster;
+	bl_uint32_t file_cluster;
+	bl_uint32_t length;
+};
+
 struct bl_fat_file_data {
 	int rootdir;
 	bl_uint32_t cluster;
 	struct bl_fat_info *info;
+
+	/* Cluster chain, built on the first read. */
+	struct bl_fat_extent *extents;
+	bl_uint32_t extents_count;
+	bl_uint32_t extents_capacity;
 };
 
 static bl_status_t bl_fat_check_regular_name(const char *filename)
@@ -66,20 +94,10 @@ static bl_status_t bl_fat_check_regular_name(const char *filename)
 	return BL_STATUS_SUCCESS;
 }
 
-static void bl_fat_short_name_free(char *filename)
-{
-	bl_heap_free(filename, 11 + sizeof('.'));
-}
-
-static char *bl_fat_short_name_to_regular_name(struct bl_fat_dir_entry *entry)
+static void bl_fat_short_name_to_regular_name(struct bl_fat_dir_entry *entry, char *s)
 {
 	int i;
 	int length1, length2;
-	char *s;
-
-	s = bl_heap_alloc(sizeof(entry->name) + sizeof('.'));
-	if (!s)
-		return NULL;
 
 	/* Short file name. */
 	for (i = BL_FAT_SHORT_FILE_NAME_LENGTH - 1; i >= 0 && entry->name[i] ==
@@ -93,16 +111,30 @@ static char *bl_fat_short_name_to_regular_name(struct bl_fat_dir_entry *entry)
 	for (i = BL_FAT_SHORT_FILE_EXTENSION_LENGTH - 1; i >= 0 && entry->name[i +
 		BL_FAT_SHORT_FILE_NAME_LENGTH] == BL_FAT_NAME_PADDING; i--) ;
 
-	if (i < 0)
-		return s;
-	else
+	if (i < 0) {
+		s[length1] = '\0';
+		return;
+	} else
 		s[length1++] = '.';
 
 	length2 = i + 1;
 	for (i = 0; i < length2; i++)
 		s[length1 + i] = entry->name[i + BL_FAT_SHORT_FILE_NAME_LENGTH];
 
-	return s;
+	s[length1 + length2] = '\0';
+}
+
+/* Checksum of the short name that long name entries carry. */
+static bl_uint8_t bl_fat_short_name_checksum(struct bl_fat_dir_entry *entry)
+{
+	int i;
+	bl_uint8_t sum;
+
+	for (i = 0, sum = 0; i < BL_FAT_SHORT_FILE_NAME_LENGTH +
+		BL_FAT_SHORT_FILE_EXTENSION_LENGTH; i++)
+		sum = ((sum & 1) << 7) + (sum >> 1) + entry->name[i];
+
+	return sum;
 }
 
 static bl_status_t bl_fat_read_rootdir(struct bl_fat_info *info, void *buf,
@@ -119,86 +151,258 @@ static inline bl_uint32_t bl_fat_entry_to_data_sector(struct bl_fat_info *info,
 	return info->data_lba + (fat_entry - 2) * BL_FAT_SECTORS_PER_CLUSTER(info);
 }
 
-/* Within the FAT itself. */
-static inline bl_uint32_t bl_fat_entry_to_sector(struct bl_fat_info *info, bl_uint32_t fat_entry)
+/* Byte of the FAT at `offset', loading its window on a miss. */
+static bl_uint8_t *bl_fat_cache_get(struct bl_fat_info *info, bl_uint32_t offset)
 {
-	return info->fat_lba + fat_entry / ((info->fat_cache_size << 3) /
-		(bl_uint32_t)info->fat_type);
+	int i, victim;
+	bl_status_t status;
+	bl_uint32_t sector, first, count;
+	struct bl_fat_cache_window *window;
+
+	sector = offset >> bl_log2(info->sector_size);
+	if (sector >= info->sectors_per_fat)
+		return NULL;
+
+	first = sector - sector % info->fat_cache_window_sectors;
+
+	victim = 0;
+	for (i = 0; i < info->fat_cache_windows; i++) {
+		window = &info->fat_cache_window[i];
+
+		if (window->sector == first) {
+			info->fat_cache_stats.hits++;
+			window->stamp = ++info->fat_cache_clock;
+			goto _found;
+		}
+
+		if (window->stamp < info->fat_cache_window[victim].stamp)
+			victim = i;
+	}
+
+	info->fat_cache_stats.misses++;
+
+	i = victim;
+	window = &info->fat_cache_window[i];
+
+	count = BL_MIN(info->fat_cache_window_sectors, info->sectors_per_fat - first);
+
+	window->sector = (bl_uint32_t)-1;
+	window->stamp = 0;
+
+	status = bl_storage_device_read(info->disk, info->fat_cache + i *
+		info->fat_cache_window_sectors * info->sector_size, info->fat_lba + first,
+		count * info->sector_size, 0);
+	if (status)
+		return NULL;
+
+	window->sector = first;
+	window->stamp = ++info->fat_cache_clock;
+
+_found:
+	return info->fat_cache + (i * info->fat_cache_window_sectors + sector - first) *
+		info->sector_size + (offset & (info->sector_size - 1));
 }
 
 static bl_uint32_t bl_fat_get_next_entry(struct bl_fat_info *info, bl_uint32_t fat_entry)
 {
-	bl_status_t status;
-	bl_uint32_t fat_sector;
+	bl_uint8_t *low, *high;
+	bl_uint32_t offset, value;
 
-	fat_sector = bl_fat_entry_to_sector(info, fat_entry);
-	if (fat_sector != info->fat_cache_sector) {
-		status = bl_storage_device_read(info->disk, info->fat_cache, fat_sector,
-			info->fat_cache_size, 0);
-		if (status)
+	switch (info->fat_type) {
+	case BL_FAT12_TYPE:
+		/* 12-bit entries may straddle sectors - fetch both bytes on their own. */
+		offset = fat_entry + fat_entry / 2;
+
+		low = bl_fat_cache_get(info, offset);
+		if (!low)
 			return 0;
 
-		info->fat_cache_sector = fat_sector;
-	}
+		value = *low;
 
-	switch (info->fat_type) {
-	case BL_FAT12_TYPE:
-		return ((bl_uint16_t *)info->fat_cache)[fat_entry] & 0xfff;
+		high = bl_fat_cache_get(info, offset + 1);
+		if (!high)
+			return 0;
+
+		value |= *high << 8;
+
+		return (fat_entry & 1) ? value >> 4 : value & 0xfff;
 
 	case BL_FAT16_TYPE:
-		return ((bl_uint16_t *)info->fat_cache)[fat_entry];
+		low = bl_fat_cache_get(info, fat_entry * 2);
+		if (!low)
+			return 0;
+
+		return *(bl_uint16_t *)low;
 
 	case BL_FAT32_TYPE:
-		return ((bl_uint32_t *)info->fat_cache)[fat_entry];
+		low = bl_fat_cache_get(info, fat_entry * 4);
+		if (!low)
+			return 0;
+
+		return *(bl_uint32_t *)low & 0x0fffffff;
 	}
 
 	return 0;
 }
 
-static bl_status_t bl_fat_read_cluster_chain(struct bl_fat_file_data *fdata, void *buf,
-	bl_size_t size, bl_offset_t offset)
+static bl_status_t bl_fat_add_extent(struct bl_fat_file_data *fdata, bl_uint32_t cluster,
+	bl_uint32_t file_cluster)
+{
+	bl_uint32_t capacity;
+	struct bl_fat_extent *extent, *extents;
+
+	if (fdata->extents_count) {
+		extent = &fdata->extents[fdata->extents_count - 1];
+		if (extent->cluster + extent->length == cluster) {
+			extent->length++;
+			return BL_STATUS_SUCCESS;
+		}
+	}
+
+	if (fdata->extents_count == fdata->extents_capacity) {
+		capacity = fdata->extents_capacity ? 2 * fdata->extents_capacity :
+			BL_FAT_INITIAL_EXTENTS;
+
+		extents = bl_heap_alloc(capacity * sizeof(struct bl_fat_extent));
+		if (!extents)
+			return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+		if (fdata->extents) {
+			bl_memcpy(extents, fdata->extents, fdata->extents_count *
+				sizeof(struct bl_fat_extent));
+			bl_heap_free(fdata->extents, fdata->extents_capacity *
+				sizeof(struct bl_fat_extent));
+		}
+
+		fdata->extents = extents;
+		fdata->extents_capacity = capacity;
+	}
+
+	extent = &fdata->extents[fdata->extents_count++];
+	extent->cluster = cluster;
+	extent->file_cluster = file_cluster;
+	extent->length = 1;
+
+	return BL_STATUS_SUCCESS;
+}
+
+static void bl_fat_free_extents(struct bl_fat_file_data *fdata)
+{
+	if (fdata->extents)
+		bl_heap_free(fdata->extents, fdata->extents_capacity * sizeof(struct bl_fat_extent));
+
+	fdata->extents = NULL;
+	fdata->extents_count = 0;
+	fdata->extents_capacity = 0;
+}
+
+/* Walk the cluster chain once, later reads only look up the extents. */
+static bl_status_t bl_fat_build_extents(struct bl_fat_file_data *fdata)
 {
-	bl_uint32_t i;
 	bl_status_t status;
-	bl_uint32_t fat_entry;
-	bl_uint32_t read_bytes, single_read_size;
+	bl_uint32_t fat_entry, file_cluster;
 	struct bl_fat_info *info;
 
 	info = fdata->info;
 
 	fat_entry = fdata->cluster;
-	for (i = 0; i < offset / info->cluster_size; i++) {
+	for (file_cluster = 0; fat_entry < info->eof; file_cluster++) {
+		/* Free, reserved or bad cluster, or a loop in the chain. */
+		if (fat_entry < 2 || fat_entry >= info->total_clusters + 2 ||
+				file_cluster == info->total_clusters) {
+			bl_fat_free_extents(fdata);
+			return BL_STATUS_FILE_SYSTEM_ERROR;
+		}
+
+		status = bl_fat_add_extent(fdata, fat_entry, file_cluster);
+		if (status) {
+			bl_fat_free_extents(fdata);
+			return status;
+		}
+
 		fat_entry = bl_fat_get_next_entry(info, fat_entry);
-		if (!fat_entry || fat_entry == info->eof)
-			return BL_STATUS_FILE_NOT_FOUND;
 	}
 
+	return BL_STATUS_SUCCESS;
+}
+
+/* Extent holding the file's `file_cluster', or -1 past the end of the chain. */
+static int bl_fat_find_extent(struct bl_fat_file_data *fdata, bl_uint32_t file_cluster)
+{
+	int low, high, middle;
+	struct bl_fat_extent *extent;
+
+	low = 0;
+	high = fdata->extents_count - 1;
+
+	while (low <= high) {
+		middle = (low + high) / 2;
+		extent = &fdata->extents[middle];
+
+		if (file_cluster < extent->file_cluster)
+			high = middle - 1;
+		else if (file_cluster >= extent->file_cluster + extent->length)
+			low = middle + 1;
+		else
+			return middle;
+	}
+
+	return -1;
+}
+
+/*
+ * One storage request per run of consecutive clusters, straight into the caller's buffer.
+ * Controllers split it to their own maximum transfer size.
+ */
+static bl_status_t bl_fat_read_cluster_chain(struct bl_fat_file_data *fdata, void *buf,
+	bl_size_t size, bl_offset_t offset)
+{
+	int i;
+	bl_status_t status;
+	bl_uint32_t file_cluster, cluster_offset, clusters;
+	bl_size_t read_bytes, single_read_size;
+	struct bl_fat_extent *extent;
+	struct bl_fat_info *info;
+
+	info = fdata->info;
+
+	if (!fdata->extents) {
+		status = bl_fat_build_extents(fdata);
+		if (status)
+			return status;
+	}
+
+	file_cluster = offset >> bl_log2(info->cluster_size);
+	cluster_offset = offset & (info->cluster_size - 1);
+
+	i = bl_fat_find_extent(fdata, file_cluster);
+	if (i < 0)
+		return BL_STATUS_FILE_NOT_FOUND;
+
 	read_bytes = 0;
-	while (1) {
-		//bl_print_hex(fat_entry);
-		//bl_print_str(" ");
+	while (size) {
+		extent = &fdata->extents[i];
 
-		single_read_size = BL_MIN(size, info->cluster_size);
+		clusters = BL_MIN(extent->file_cluster + extent->length - file_cluster,
+			BL_MEMORY_ALIGN_UP(cluster_offset + size, info->cluster_size) >>
+			bl_log2(info->cluster_size));
+		single_read_size = BL_MIN(size, clusters * info->cluster_size - cluster_offset);
 
 		status = bl_storage_device_read(info->disk, (bl_uint8_t *)buf + read_bytes,
-			bl_fat_entry_to_data_sector(info, fat_entry), single_read_size,
-			offset % info->cluster_size);
+			bl_fat_entry_to_data_sector(info, extent->cluster + file_cluster -
+			extent->file_cluster), single_read_size, cluster_offset);
 		if (status)
 			return status;
 
 		size -= single_read_size;
-		if (size == 0)
-			break;
-
 		read_bytes += single_read_size;
+		file_cluster += clusters;
+		cluster_offset = 0;
 
-		fat_entry = bl_fat_get_next_entry(info, fat_entry);
-		if (!fat_entry || fat_entry == info->eof)
+		if (size && ++i == (int)fdata->extents_count)
 			return BL_STATUS_FILE_NOT_FOUND;
 	}
 
-	//bl_print_str("\n");
-
 	return BL_STATUS_SUCCESS;
 }
 
@@ -214,57 +418,193 @@ static bl_status_t bl_fat_generic_read(struct bl_fat_file_data *fdata, void *buf
 		return bl_fat_read_cluster_chain(fdata, buf, size, offset);
 }
 
+/* Size of a directory, the FAT12/16 root directory has its own region. */
+static bl_status_t bl_fat_directory_size(struct bl_fat_file_data *fdata, bl_size_t *size)
+{
+	bl_status_t status;
+	struct bl_fat_extent *extent;
+
+	if (fdata->rootdir && (fdata->info->fat_type == BL_FAT12_TYPE ||
+		fdata->info->fat_type == BL_FAT16_TYPE)) {
+		*size = fdata->info->rootdir_entries * sizeof(struct bl_fat_dir_entry);
+		return BL_STATUS_SUCCESS;
+	}
+
+	if (!fdata->extents) {
+		status = bl_fat_build_extents(fdata);
+		if (status)
+			return status;
+	}
+
+	*size = 0;
+	if (fdata->extents_count) {
+		extent = &fdata->extents[fdata->extents_count - 1];
+		*size = (extent->file_cluster + extent->length) * fdata->info->cluster_size;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+/*
+ * Directories are read a cluster at a time and walked in memory. Long name
+ * entries precede their short entry and are assembled on the way.
+ */
 struct bl_fat_iterator {
 	int type;
-	char *filename;
+	char filename[BL_FAT_LONG_NAME_ENTRIES * BL_FAT_LONG_NAME_ENTRY_CHARS + 1];
+
+	/* Files with a long name can be opened by their short one too. */
+	char short_name[BL_FAT_SHORT_FILE_NAME_LENGTH + BL_FAT_SHORT_FILE_EXTENSION_LENGTH + 2];
 
 	int empty;
 
-	int entry;
+	bl_uint32_t entry;
 	bl_uint32_t cluster;
 
 	struct bl_fat_file_data *fdata;
+
+	/* Entries from `first' on, `count' of them are valid. */
+	struct bl_fat_dir_entry *buf;
+	bl_uint32_t first;
+	bl_uint32_t count;
+	bl_size_t size;
+
+	/* Long name being assembled - next sequence number expected & checksum. */
+	char long_name[BL_FAT_LONG_NAME_ENTRIES * BL_FAT_LONG_NAME_ENTRY_CHARS + 1];
+	int long_name_next;
+	bl_uint8_t long_name_checksum;
 };
 
-static bl_status_t bl_fat_iterator_next(struct bl_fat_iterator *it)
+static inline char bl_fat_long_name_char(bl_uint16_t c)
+{
+	/* Names are matched in ASCII. */
+	return c < 0x80 ? (char)c : '?';
+}
+
+static inline void bl_fat_iterator_drop_long_name(struct bl_fat_iterator *it)
+{
+	it->long_name[0] = '\0';
+	it->long_name_next = 0;
+}
+
+static void bl_fat_iterator_add_long_name(struct bl_fat_iterator *it,
+	struct bl_fat_long_name_entry *entry)
+{
+	int i, sequence;
+	char *s;
+
+	sequence = entry->order & BL_FAT_LONG_NAME_ORDER_MASK;
+
+	if (entry->order & BL_FAT_LONG_NAME_LAST) {
+		if (sequence < 1 || sequence > BL_FAT_LONG_NAME_ENTRIES) {
+			bl_fat_iterator_drop_long_name(it);
+			return;
+		}
+
+		it->long_name[sequence * BL_FAT_LONG_NAME_ENTRY_CHARS] = '\0';
+		it->long_name_checksum = entry->checksum;
+	} else if (sequence != it->long_name_next || entry->checksum != it->long_name_checksum) {
+		bl_fat_iterator_drop_long_name(it);
+		return;
+	}
+
+	s = &it->long_name[(sequence - 1) * BL_FAT_LONG_NAME_ENTRY_CHARS];
+
+	for (i = 0; i < 5; i++)
+		*s++ = bl_fat_long_name_char(entry->name1[i]);
+	for (i = 0; i < 6; i++)
+		*s++ = bl_fat_long_name_char(entry->name2[i]);
+	for (i = 0; i < 2; i++)
+		*s++ = bl_fat_long_name_char(entry->name3[i]);
+
+	it->long_name_next = sequence - 1;
+}
+
+/* Pull the next cluster (or root directory run) of entries into memory. */
+static bl_status_t bl_fat_iterator_fill(struct bl_fat_iterator *it)
 {
 	bl_status_t status;
-	struct bl_fat_dir_entry entry;
+	bl_size_t offset, size;
 
-	/* Read directory entry. */
-	status = bl_fat_generic_read(it->fdata, (void *)&entry, sizeof(struct bl_fat_dir_entry),
-		(it->entry - 1) * sizeof(struct bl_fat_dir_entry));
+	offset = (it->first + it->count) * sizeof(struct bl_fat_dir_entry);
+	if (offset >= it->size) {
+		it->empty = 1;
+		return BL_STATUS_SUCCESS;
+	}
+
+	size = BL_MIN(it->size - offset, it->fdata->info->cluster_size);
+
+	status = bl_fat_generic_read(it->fdata, it->buf, size, offset);
 	if (status)
 		return status;
 
-	/* Have we reached the end ? */
-	if (entry.name[0] == BL_FAT_AVAILABLE_ENTRY_FLAG) {
-		it->empty = 1;
-		return BL_STATUS_SUCCESS;
+	it->first += it->count;
+	it->count = size / sizeof(struct bl_fat_dir_entry);
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_fat_iterator_next(struct bl_fat_iterator *it)
+{
+	bl_status_t status;
+	struct bl_fat_dir_entry *entry;
+
+	while (1) {
+		if (it->entry == it->first + it->count) {
+			status = bl_fat_iterator_fill(it);
+			if (status || it->empty)
+				return status;
+		}
+
+		entry = &it->buf[it->entry++ - it->first];
+
+		/* Have we reached the end ? */
+		if (entry->name[0] == BL_FAT_AVAILABLE_ENTRY_FLAG) {
+			it->empty = 1;
+			return BL_STATUS_SUCCESS;
+		}
+
+		if (entry->name[0] == BL_FAT_DELETED_ENTRY_FLAG) {
+			bl_fat_iterator_drop_long_name(it);
+			continue;
+		}
+
+		if ((entry->attributes & BL_FAT_DIR_ENTRY_ATTR_LONG_NAME_MASK) ==
+			BL_FAT_DIR_ENTRY_ATTR_LONG_NAME) {
+			bl_fat_iterator_add_long_name(it, (struct bl_fat_long_name_entry *)entry);
+			continue;
+		}
+
+		/* Volume label. */
+		if (entry->attributes & BL_FAT_DIR_ENTRY_ATTR_VOLUME) {
+			bl_fat_iterator_drop_long_name(it);
+			continue;
+		}
+
+		break;
 	}
 
 	/* File type & name manipulation. */
-	if ((entry.attributes & BL_FAT_DIR_ENTRY_ATTR_VOLUME) == 0) {
-		if (entry.attributes & BL_FAT_DIR_ENTRY_ATTR_DIR)
-			it->type = BL_FILE_TYPE_DIRECTORY;
-		else
-			it->type = BL_FILE_TYPE_REGULAR;
+	if (entry->attributes & BL_FAT_DIR_ENTRY_ATTR_DIR)
+		it->type = BL_FILE_TYPE_DIRECTORY;
+	else
+		it->type = BL_FILE_TYPE_REGULAR;
 
-		if (it->filename)
-			bl_fat_short_name_free(it->filename);
+	bl_fat_short_name_to_regular_name(entry, it->short_name);
 
-		it->filename = bl_fat_short_name_to_regular_name(&entry);
-		if (!it->filename)
-			return BL_STATUS_FAILURE;
-	} else {
-		it->type = BL_FILE_TYPE_UNKNOWN;
-		it->filename = NULL;
-	}
+	/* Long name only when complete & belonging to this entry. */
+	if (it->long_name_next == 0 && it->long_name[0] &&
+		it->long_name_checksum == bl_fat_short_name_checksum(entry))
+		bl_strcpy(it->filename, it->long_name);
+	else
+		bl_strcpy(it->filename, it->short_name);
 
-	/* Cluster. */
-	it->cluster = entry.start;
+	bl_fat_iterator_drop_long_name(it);
 
-	it->entry++;
+	/* Cluster. */
+	it->cluster = entry->start;
+	if (it->fdata->info->fat_type == BL_FAT32_TYPE)
+		it->cluster |= (bl_uint32_t)entry->start_high << 16;
 
 	return BL_STATUS_SUCCESS;
 }
@@ -276,22 +616,42 @@ static int bl_fat_iterator_end(struct bl_fat_iterator *it)
 
 static void bl_fat_iterator_uninit(struct bl_fat_iterator *it)
 {
-	if (it->filename)
-		bl_fat_short_name_free(it->filename);
+	if (it->buf)
+		bl_heap_free(it->buf, it->fdata->info->cluster_size);
 
 	bl_memset(it, 0, sizeof(struct bl_fat_iterator));
 }
 
-static void bl_fat_iterator_init(struct bl_fat_file_data *fdata, struct bl_fat_iterator *it)
+static bl_status_t bl_fat_iterator_init(struct bl_fat_file_data *fdata,
+	struct bl_fat_iterator *it)
 {
+	bl_status_t status;
+
 	it->type = BL_FILE_TYPE_UNKNOWN;
-	it->filename = NULL;
+	it->filename[0] = '\0';
+	it->short_name[0] = '\0';
 
 	it->empty = 0;
 
-	it->entry = 1;
+	it->entry = 0;
+	it->first = 0;
+	it->count = 0;
+
+	bl_fat_iterator_drop_long_name(it);
 
 	it->fdata = fdata;
+
+	it->buf = bl_heap_alloc(fdata->info->cluster_size);
+	if (!it->buf)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	status = bl_fat_directory_size(fdata, &it->size);
+	if (status) {
+		bl_heap_free(it->buf, fdata->info->cluster_size);
+		it->buf = NULL;
+	}
+
+	return status;
 }
 
 static bl_status_t bl_fat_iterate_directory_callback(const char *filename, int directory,
@@ -311,59 +671,62 @@ static bl_status_t bl_fat_iterate_directory_callback(const char *filename, int d
 
 	fdata = dirdata;
 
-	bl_fat_iterator_init(fdata, &it);
+	status = bl_fat_iterator_init(fdata, &it);
+	if (status)
+		return status;
 
 	for ((status = bl_fat_iterator_next(&it)); !bl_fat_iterator_end(&it);
 		(status = bl_fat_iterator_next(&it))) {
-		/* Verify file. */
 		if (status)
 			goto _exit;
 
+		if (bl_strcasecmp(it.filename, filename) && bl_strcasecmp(it.short_name, filename))
+			continue;
+
+		/* Verify file. */
 		if (directory && it.type != BL_FILE_TYPE_DIRECTORY) {
 			status = BL_STATUS_INVALID_FILE_TYPE;
 			goto _exit;
 		}
 
-		if (it.type != BL_FILE_TYPE_UNKNOWN && !bl_strcasecmp(it.filename, filename)) {
-			//bl_print_str(it.filename);
-			//bl_print_str(" ");
-
-			/* Construct tree node. */
-			_node = bl_heap_alloc(sizeof(struct bl_file_tree_node));
-			if (!_node) {
-				status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
-				goto _exit;
-			}
+		/* Construct tree node. */
+		_node = bl_heap_alloc(sizeof(struct bl_file_tree_node));
+		if (!_node) {
+			status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
+			goto _exit;
+		}
 
-			_node->fdata = NULL;
-			_node->fdata = bl_heap_alloc(sizeof(struct bl_fat_file_data));
-			if (!_node->fdata) {
-				status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
-				goto _exit;
-			}
+		_node->fdata = NULL;
+		_node->fdata = bl_heap_alloc(sizeof(struct bl_fat_file_data));
+		if (!_node->fdata) {
+			status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
+			goto _exit;
+		}
 
-			((struct bl_fat_file_data *)_node->fdata)->rootdir = 0;
-			((struct bl_fat_file_data *)_node->fdata)->cluster = it.cluster;
-			((struct bl_fat_file_data *)_node->fdata)->info = fdata->info;
+		((struct bl_fat_file_data *)_node->fdata)->rootdir = 0;
+		((struct bl_fat_file_data *)_node->fdata)->cluster = it.cluster;
+		((struct bl_fat_file_data *)_node->fdata)->info = fdata->info;
+		((struct bl_fat_file_data *)_node->fdata)->extents = NULL;
+		((struct bl_fat_file_data *)_node->fdata)->extents_count = 0;
+		((struct bl_fat_file_data *)_node->fdata)->extents_capacity = 0;
 
-			*node = _node;
-			_node = NULL;
+		*node = _node;
+		_node = NULL;
 
-			break;
-		}
+		break;
 	}
 
-	//if (!node) {
-	//	return BL_STATUS_FILE_NOT_FOUND;
-	//}
+	if (status)
+		goto _exit;
 
-	status = BL_STATUS_SUCCESS;
+	if (!*node)
+		status = BL_STATUS_FILE_NOT_FOUND;
 
 _exit:
 	if (_node) {
-		bl_heap_free(_node, sizeof(struct bl_file_tree_node));
 		if (_node->fdata)
 			bl_heap_free(_node->fdata, sizeof(struct bl_fat_file_data));
+		bl_heap_free(_node, sizeof(struct bl_file_tree_node));
 	}
 
 	bl_fat_iterator_uninit(&it);
@@ -374,31 +737,56 @@ _exit:
 static bl_status_t bl_fat_open(bl_fs_handle_t handle, const char *path, bl_file_t *file)
 {
 	bl_status_t status;
+	struct bl_dentry *dentry;
+	bl_file_t _file;
 	struct bl_file_tree_node *root = NULL;
 
-	/* Prepare root node. */
-	root = bl_heap_alloc(sizeof(struct bl_file_tree_node));
-	if (!root) {
-		status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
-		goto _exit;
+	/* Prepare root node, until the mount caches one. */
+	if (!handle->dcache.root) {
+		root = bl_heap_alloc(sizeof(struct bl_file_tree_node));
+		if (!root) {
+			status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
+			goto _exit;
+		}
+
+		root->fdata = NULL;
+		root->prev = NULL;
+
+		root->fdata = bl_heap_alloc(sizeof(struct bl_fat_file_data));
+		if (!root->fdata) {
+			status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
+			goto _exit;
+		}
+
+		((struct bl_fat_file_data *)root->fdata)->rootdir = 1;
+		((struct bl_fat_file_data *)root->fdata)->info = (struct bl_fat_info *)handle->info;
+		((struct bl_fat_file_data *)root->fdata)->cluster =
+			((struct bl_fat_info *)handle->info)->rootdir_cluster;
+		((struct bl_fat_file_data *)root->fdata)->extents = NULL;
+		((struct bl_fat_file_data *)root->fdata)->extents_count = 0;
+		((struct bl_fat_file_data *)root->fdata)->extents_capacity = 0;
 	}
 
-	root->fdata = NULL;
-	root->prev = NULL;
-	
-	root->fdata = bl_heap_alloc(sizeof(struct bl_fat_file_data));
-	if (!root->fdata) {
+	/* Iterate FAT. The root node is taken over by the iteration. */
+	status = bl_file_iterate_path(handle, path, root,
+		&bl_fat_iterate_directory_callback, &dentry);
+	root = NULL;
+	if (status)
+		goto _exit;
+
+	/* Return file handle. */
+	_file = bl_heap_alloc(sizeof(*_file));
+	if (!_file) {
+		bl_dcache_put(handle, dentry);
 		status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
 		goto _exit;
 	}
 
-	((struct bl_fat_file_data *)root->fdata)->rootdir = 1;
-	((struct bl_fat_file_data *)root->fdata)->info = (struct bl_fat_info *)handle->info;
+	_file->handle = handle;
+	_file->fdata = dentry->fdata;
+	_file->dentry = dentry;
 
-
-	/* Iterate FAT. */
-	status = bl_file_iterate_path(handle->fs, path, root,
-		&bl_fat_iterate_directory_callback, &file->fdata);
+	*file = _file;
 
 _exit:
 	if (root) {
@@ -411,14 +799,20 @@ _exit:
 	return status;
 }
 
+static bl_size_t bl_fat_fdata_size(bl_file_data_t fdata)
+{
+	return sizeof(struct bl_fat_file_data) + ((struct bl_fat_file_data *)fdata)->extents_capacity *
+		sizeof(struct bl_fat_extent);
+}
+
 static bl_status_t bl_fat_close(bl_file_data_t fdata)
 {
 	if (!fdata)
 		return BL_STATUS_INVALID_PARAMETERS;
 
-	((struct bl_fat_file_data *)fdata)->rootdir = -1;
-	((struct bl_fat_file_data *)fdata)->cluster = (bl_uint32_t)-1;
-	((struct bl_fat_file_data *)fdata)->info = NULL;
+	bl_fat_free_extents(fdata);
+
+	bl_heap_free(fdata, sizeof(struct bl_fat_file_data));
 
 	return BL_STATUS_SUCCESS;
 }
@@ -427,6 +821,7 @@ static bl_status_t bl_fat_check_fat(struct bl_storage_device *disk, struct bl_pa
 	struct bl_fat_info *info)
 {
 	bl_status_t status;
+	int i;
 	struct bl_fat_vbr vbr;
 
 	info->disk = disk;
@@ -437,7 +832,8 @@ static bl_status_t bl_fat_check_fat(struct bl_storage_device *disk, struct bl_pa
 		return status;
 
 	/* Is this realy FAT ? */
-	if (!vbr.bpb.num_of_fats || !vbr.bpb.rootdir_entries || vbr.signature != BL_MBR_SIGNATURE ||
+	if (!vbr.bpb.num_of_fats || (!vbr.bpb.rootdir_entries && vbr.bpb.sectors_per_fat16) ||
+		vbr.signature != BL_MBR_SIGNATURE ||
 		bl_log2(vbr.bpb.bytes_per_sector) == -1 || bl_log2(vbr.bpb.sectors_per_cluster) == -1)
 		return BL_STATUS_INVALID_FILE_SYSTEM;
 
@@ -461,6 +857,7 @@ static bl_status_t bl_fat_check_fat(struct bl_storage_device *disk, struct bl_pa
 	/* Root directory. */
 	info->rootdir_lba = info->fat_lba + info->sectors_per_fat * vbr.bpb.num_of_fats;
 	info->rootdir_entries = vbr.bpb.rootdir_entries;
+	info->rootdir_cluster = vbr.bpb.sectors_per_fat16 ? 0 : vbr.ebpb32.root_cluster;
 
 	/* Data. */
 	info->data_lba = info->rootdir_lba + BL_MEMORY_ALIGN_UP(info->rootdir_entries *
@@ -485,19 +882,50 @@ static bl_status_t bl_fat_check_fat(struct bl_storage_device *disk, struct bl_pa
 	}
 
 	/* FAT cache. */
-	info->fat_cache_size = info->sector_size;
-	if (info->fat_type == BL_FAT12_TYPE)
-		info->fat_cache_size += 3 - info->sector_size % 3;
+	if (info->sectors_per_fat <= BL_FAT_CACHE_FULL_MAX_SECTORS) {
+		info->fat_cache_windows = 1;
+		info->fat_cache_window_sectors = info->sectors_per_fat;
+	} else {
+		info->fat_cache_windows = BL_FAT_CACHE_WINDOWS;
+		info->fat_cache_window_sectors = BL_FAT_CACHE_WINDOW_SECTORS;
+	}
+
+	info->fat_cache_size = info->fat_cache_windows * info->fat_cache_window_sectors *
+		info->sector_size;
 
 	info->fat_cache = bl_heap_alloc(info->fat_cache_size);
 	if (!info->fat_cache)
 		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
 
-	info->fat_cache_sector = (bl_uint32_t)-1;
+	for (i = 0; i < info->fat_cache_windows; i++) {
+		info->fat_cache_window[i].sector = (bl_uint32_t)-1;
+		info->fat_cache_window[i].stamp = 0;
+	}
+
+	info->fat_cache_clock = 0;
+	info->fat_cache_stats.hits = 0;
+	info->fat_cache_stats.misses = 0;
 
 	return BL_STATUS_SUCCESS;
 }
 
+static void bl_fat_dump_stats(bl_fs_info_t info)
+{
+	struct bl_fat_info *_info;
+
+	_info = info;
+
+	bl_print_str("FAT cache: ");
+
+	bl_print_str("Hits: ");
+	bl_print_decimal64(_info->fat_cache_stats.hits);
+	bl_print_str(" ");
+
+	bl_print_str("Misses: ");
+	bl_print_decimal64(_info->fat_cache_stats.misses);
+	bl_print_str("\n");
+}
+
 static bl_status_t bl_fat_mount(struct bl_storage_device *disk, struct bl_partition *partition,
 	bl_fs_info_t *info)
 {
@@ -538,6 +966,9 @@ static struct bl_fs bl_fat_fs = {
 	.umount = bl_fat_umount,
 	.open = bl_fat_open,
 	.close = bl_fat_close,
+	.fdata_size = bl_fat_fdata_size,
+	.dump_stats = bl_fat_dump_stats,
+	.case_insensitive = 1,
 };
 
 BL_MODULE_INIT()
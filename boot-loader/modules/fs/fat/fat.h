@@ -24,6 +24,14 @@ enum {
 	BL_FAT32_EOF	= 0xffffff8,
 };
 
+/* FAT cache - FATs up to this size are read whole, bigger ones in LRU windows. */
+#define BL_FAT_CACHE_FULL_MAX_SECTORS	256
+#define BL_FAT_CACHE_WINDOWS		8
+#define BL_FAT_CACHE_WINDOW_SECTORS	16
+
+/* Extents allocated for an open file at first, doubled when full. */
+#define BL_FAT_INITIAL_EXTENTS	8
+
 /* FAT BIOS Parameter Block */
 struct bl_fat_bpb {
 	__u8	jump_code[3];		/* Offset : 0x000 */
@@ -88,6 +96,7 @@ struct bl_fat_vbr {
 #define BL_FAT_NAME_PADDING	' '
 
 #define BL_FAT_AVAILABLE_ENTRY_FLAG	0x00
+#define BL_FAT_DELETED_ENTRY_FLAG	0xe5
 
 /* FAT file attributes */
 enum {
@@ -98,6 +107,10 @@ enum {
 	BL_FAT_DIR_ENTRY_ATTR_VOLUME	= 0x08,
 	BL_FAT_DIR_ENTRY_ATTR_DIR	= 0x10,
 	BL_FAT_DIR_ENTRY_ATTR_ARCHIVE	= 0x20,
+
+	/* Long file name entries are marked by RO, hidden, system & volume together. */
+	BL_FAT_DIR_ENTRY_ATTR_LONG_NAME		= 0x0f,
+	BL_FAT_DIR_ENTRY_ATTR_LONG_NAME_MASK	= 0x3f,
 };
 
 /* FAT Directory Entry */
@@ -116,5 +129,23 @@ struct bl_fat_dir_entry {
 	__u32	size;			/* Offset : 0x1c */
 } __attribute__((packed));
 
+/* FAT Long File Name Entry */
+struct bl_fat_long_name_entry {
+	__u8	order;			/* Offset : 0x00 */
+	__u16	name1[5];		/* Offset : 0x01 */
+	__u8	attributes;		/* Offset : 0x0b */
+	__u8	type;			/* Offset : 0x0c */
+	__u8	checksum;		/* Offset : 0x0d */
+	__u16	name2[6];		/* Offset : 0x0e */
+	__u16	start;			/* Offset : 0x1a */
+	__u16	name3[2];		/* Offset : 0x1c */
+} __attribute__((packed));
+
+/* Long names - up to 20 entries of 13 characters, the last one flagged in `order'. */
+#define BL_FAT_LONG_NAME_ENTRIES	20
+#define BL_FAT_LONG_NAME_ENTRY_CHARS	13
+#define BL_FAT_LONG_NAME_ORDER_MASK	0x1f
+#define BL_FAT_LONG_NAME_LAST		0x40
+
 #endif
 
@@ -487,50 +487,55 @@ static bl_status_t bl_ntfs_open(bl_fs_handle_t handle, const char *path, bl_file
 	bl_status_t status;
 	struct bl_file_tree_node *root;
 	struct bl_ntfs_info *info;
-	bl_file_data_t *fdata;
+	struct bl_dentry *dentry;
 	bl_file_t _file;
 
-	/* Prepare root node. */
-	root = bl_heap_alloc(sizeof(struct bl_file_tree_node));
-	if (!root) {
-		status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
-		goto _exit;
-	}
+	/* Prepare root node, until the mount caches one. */
+	root = NULL;
+	if (!handle->dcache.root) {
+		root = bl_heap_alloc(sizeof(struct bl_file_tree_node));
+		if (!root) {
+			status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
+			goto _exit;
+		}
 
-	root->fdata = NULL;
-	root->prev = NULL;
+		root->fdata = NULL;
+		root->prev = NULL;
 
-	root->fdata = bl_heap_alloc(sizeof(struct bl_ntfs_file_data));
-	if (!root->fdata) {
-		status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
-		goto _exit;
-	}
+		root->fdata = bl_heap_alloc(sizeof(struct bl_ntfs_file_data));
+		if (!root->fdata) {
+			status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
+			goto _exit;
+		}
 
-	((struct bl_ntfs_file_data *)root->fdata)->dir = 1;
+		((struct bl_ntfs_file_data *)root->fdata)->dir = 1;
 
-	((struct bl_ntfs_file_data *)root->fdata)->rootdir = 1;
+		((struct bl_ntfs_file_data *)root->fdata)->rootdir = 1;
 
-	info = handle->info;
-	((struct bl_ntfs_file_data *)root->fdata)->mft_record = info->mft_root;
-	((struct bl_ntfs_file_data *)root->fdata)->iroot = info->iroot;
+		info = handle->info;
+		((struct bl_ntfs_file_data *)root->fdata)->mft_record = info->mft_root;
+		((struct bl_ntfs_file_data *)root->fdata)->iroot = info->iroot;
 
-	((struct bl_ntfs_file_data *)root->fdata)->info = info;
+		((struct bl_ntfs_file_data *)root->fdata)->info = info;
+	}
 
-	/* Iterate NTFS. The callback must make sure it frees root node memory. */
-	status = bl_file_iterate_path(handle->fs, path, root, &bl_ntfs_iterate_directory_callback,
-			&fdata);
+	/* Iterate NTFS. The root node is taken over by the iteration. */
+	status = bl_file_iterate_path(handle, path, root, &bl_ntfs_iterate_directory_callback,
+			&dentry);
 	if (status)
 		goto _exit;
 
 	/* Return file handle. */
 	_file = bl_heap_alloc(sizeof(*_file));
 	if (!_file) {
+		bl_dcache_put(handle, dentry);
 		status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
 		goto _exit;
 	}
 
 	_file->handle = handle;
-	_file->fdata = fdata;
+	_file->fdata = dentry->fdata;
+	_file->dentry = dentry;
 
 	*file = _file;
 	_file = NULL;	
@@ -539,6 +544,19 @@ _exit:
 	return status;
 }
 
+static bl_size_t bl_ntfs_fdata_size(bl_file_data_t btree)
+{
+	struct bl_ntfs_file_data *fdata;
+
+	fdata = btree;
+
+	/* The root directory MFT record belongs to the file system info. */
+	if (fdata->rootdir)
+		return sizeof(struct bl_ntfs_file_data);
+
+	return sizeof(struct bl_ntfs_file_data) + fdata->info->mft_record_size;
+}
+
 static bl_status_t bl_ntfs_close(bl_file_data_t btree)
 {
 	struct bl_ntfs_file_data *fdata;
@@ -552,7 +570,7 @@ static bl_status_t bl_ntfs_close(bl_file_data_t btree)
 	if (!fdata->rootdir)
 		bl_heap_free(fdata->mft_record, fdata->info->mft_record_size);
 
-	bl_memset(fdata, 0, sizeof(struct bl_ntfs_file_data));
+	bl_heap_free(fdata, sizeof(struct bl_ntfs_file_data));
 
 	return BL_STATUS_SUCCESS;
 }
@@ -799,7 +817,9 @@ static struct bl_fs bl_ntfs_fs = {
 	.umount = bl_ntfs_umount,
 	.open = bl_ntfs_open,
 	.close = bl_ntfs_close,
+	.fdata_size = bl_ntfs_fdata_size,
 	.ls = bl_ntfs_ls,
+	.case_insensitive = 1,
 };
 
 BL_MODULE_INIT()
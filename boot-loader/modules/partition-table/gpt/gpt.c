@@ -1,5 +1,6 @@
 #include "gpt.h"
 #include "include/string.h"
+#include "include/bl-utils.h"
 #include "include/mbr.h"
 #include "core/include/loader/loader.h"
 #include "core/include/storage/storage.h"
@@ -8,14 +9,128 @@
 
 BL_MODULE_NAME("GUID Partition Table");
 
+/* Read & validate a GPT header, the whole sector is needed for the CRC. */
+static bl_status_t bl_gpt_read_header(struct bl_storage_device *disk, bl_uint64_t lba,
+	struct bl_gpt_header *gpt)
+{
+	bl_uint8_t *sector;
+	bl_uint32_t crc32;
+	bl_status_t status;
+	struct bl_gpt_header *header;
+
+	sector = bl_heap_alloc(BL_STORAGE_SECTOR_SIZE);
+	if (!sector)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	status = bl_storage_device_read(disk, sector, lba, BL_STORAGE_SECTOR_SIZE, 0);
+	if (status)
+		goto _exit;
+
+	header = (struct bl_gpt_header *)sector;
+
+	status = BL_STATUS_UNSUPPORTED;
+
+	if (bl_memcmp(header->signature, BL_GPT_SIGNATURE, sizeof(header->signature)))
+		goto _exit;
+
+	if (header->header_size < BL_GPT_MIN_HEADER_SIZE ||
+			header->header_size > BL_STORAGE_SECTOR_SIZE)
+		goto _exit;
+
+	/* CRC is calculated with its own field zeroed. */
+	crc32 = header->crc32;
+	header->crc32 = 0;
+	if (bl_crc32(0, header, header->header_size) != crc32)
+		goto _exit;
+
+	header->crc32 = crc32;
+
+	if (header->current_lba != lba || header->partition_entry_size < BL_GPT_MIN_ENTRY_SIZE ||
+			(header->partition_entry_size % 8) ||
+			header->partitions_count > BL_GPT_MAX_ENTRIES_SIZE / header->partition_entry_size)
+		goto _exit;
+
+	bl_memcpy(gpt, header, sizeof(struct bl_gpt_header));
+	status = BL_STATUS_SUCCESS;
+
+_exit:
+	bl_heap_free(sector, BL_STORAGE_SECTOR_SIZE);
+
+	return status;
+}
+
+/* Whole partition entry array in one read, checked against the header. */
+static bl_status_t bl_gpt_read_entries(struct bl_storage_device *disk,
+	struct bl_gpt_header *gpt, bl_uint8_t **entries)
+{
+	bl_size_t size;
+	bl_uint8_t *buf;
+	bl_status_t status;
+
+	size = gpt->partitions_count * gpt->partition_entry_size;
+
+	buf = bl_heap_alloc(size);
+	if (!buf)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	status = bl_storage_device_read(disk, buf, gpt->partitions_lba, size, 0);
+	if (status)
+		goto _failed;
+
+	if (bl_crc32(0, buf, size) != gpt->partitions_crc32) {
+		status = BL_STATUS_UNSUPPORTED;
+		goto _failed;
+	}
+
+	*entries = buf;
+
+	return BL_STATUS_SUCCESS;
+
+_failed:
+	bl_heap_free(buf, size);
+
+	return status;
+}
+
+/* Primary GPT first, the backup at the end of the disk if it doesn't check out. */
+static bl_status_t bl_gpt_read(struct bl_storage_device *disk, struct bl_gpt_header *gpt,
+	bl_uint8_t **entries)
+{
+	bl_uint64_t backup_lba;
+	bl_status_t status;
+
+	backup_lba = disk->sector_count - 1;
+
+	status = bl_gpt_read_header(disk, 1, gpt);
+	if (status == BL_STATUS_MEMORY_ALLOCATION_FAILED)
+		return status;
+
+	if (!status) {
+		backup_lba = gpt->backup_lba;
+
+		status = bl_gpt_read_entries(disk, gpt, entries);
+		if (status != BL_STATUS_UNSUPPORTED)
+			return status;
+	}
+
+	bl_print_str("GPT: primary table is corrupted, using the backup\n");
+
+	status = bl_gpt_read_header(disk, backup_lba, gpt);
+	if (status)
+		return status;
+
+	return bl_gpt_read_entries(disk, gpt, entries);
+}
+
 static bl_status_t bl_gpt_iterate(struct bl_storage_device *disk)
 {
 	int i;
 	struct bl_mbr mbr;
 	struct bl_gpt_header gpt;
-	struct bl_gpt_partition_entry entry;
-	bl_uint64_t entry_offset;
+	struct bl_gpt_partition_entry *entry;
+	bl_uint8_t *entries;
 	bl_status_t status;
+	bl_guid_t empty_guid = BL_GPT_UNUSED_ENTRY;
 
 	status = bl_storage_device_read(disk, (bl_uint8_t *)&mbr, 0, sizeof(struct bl_mbr), 0);
 	if (status)
@@ -33,40 +148,34 @@ static bl_status_t bl_gpt_iterate(struct bl_storage_device *disk)
 	if (i == 4)
 		return BL_STATUS_UNSUPPORTED;
 
-	/* Read GPT header. */
-	status = bl_storage_device_read(disk, (bl_uint8_t *)&gpt, 1, sizeof(struct bl_gpt_header), 0);
+	status = bl_gpt_read(disk, &gpt, &entries);
 	if (status)
 		return status;
 
-	if (bl_memcmp(gpt.signature, BL_GPT_SIGNATURE, sizeof(gpt.signature)))
-		return BL_STATUS_UNSUPPORTED;
-
-	/* Read GPT partition entries. Each entry is 128 bytes. */
-	for (i = 0, entry_offset = 0; i < gpt.partitions_count; i++, entry_offset +=
-			gpt.partition_entry_size) {
-		/* Record every non-empty partition. */
-		status = bl_storage_device_read(disk, (bl_uint8_t *)&entry, gpt.partitions_lba +
-				entry_offset / BL_STORAGE_SECTOR_SIZE, sizeof(struct bl_gpt_partition_entry),
-				entry_offset % BL_STORAGE_SECTOR_SIZE);
-		if (status)
-			return status;
+	/* Record every non-empty partition. */
+	for (i = 0; i < gpt.partitions_count; i++) {
+		entry = (struct bl_gpt_partition_entry *)(entries + i * gpt.partition_entry_size);
 
-		bl_guid_t empty_guid = BL_GPT_UNUSED_ENTRY;
-		if (!bl_memcmp((void *)&entry.partition_type_guid, (void *)&empty_guid, sizeof(bl_guid_t)))
+		if (!bl_memcmp((void *)&entry->partition_type_guid, (void *)&empty_guid,
+				sizeof(bl_guid_t)))
 			continue;
 
 		struct bl_partition *partition = bl_heap_alloc(sizeof(struct bl_partition));
-		if (!partition)
-			return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+		if (!partition) {
+			status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
+			break;
+		}
 
-		partition->lba = entry.first_lba;
-		partition->sectors = entry.last_lba - entry.first_lba;
+		partition->lba = entry->first_lba;
+		partition->sectors = entry->last_lba - entry->first_lba;
 
 		partition->next = disk->partitions;
 		disk->partitions = partition;
 	}
 
-	return BL_STATUS_SUCCESS;
+	bl_heap_free(entries, gpt.partitions_count * gpt.partition_entry_size);
+
+	return status;
 }
 
 static struct bl_partition_table_functions gpt_functions = {
@@ -23,6 +23,11 @@ struct bl_gpt_header {
 	__u32		partitions_crc32;
 } __attribute__((packed));
 
+/* Sanity limits for the header & the partition entry array. */
+#define BL_GPT_MIN_HEADER_SIZE		92
+#define BL_GPT_MIN_ENTRY_SIZE		128
+#define BL_GPT_MAX_ENTRIES_SIZE		(1024 * 1024)
+
 /* Empty GPT partition. */
 #define BL_GPT_UNUSED_ENTRY	\
 	{ 0x00000000, 0x0000, 0x0000, { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00} }
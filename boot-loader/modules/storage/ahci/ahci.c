@@ -35,6 +35,13 @@ struct bl_ahci_controller {
 struct bl_ahci_device {
 	struct bl_sata_identification id;
 
+	/* Native Command Queuing - one tag per command slot. */
+	int ncq;
+	int slots;
+
+	/* Slots aborted by error recovery, not yet reported to their waiter. */
+	bl_uint32_t failed;
+
 	struct bl_ahci_port *port;
 	struct bl_ahci_controller *controller;
 
@@ -53,9 +60,9 @@ static int bl_ahci_find_free_command_slot(struct bl_ahci_device *device)
 	int i;
 	bl_uint32_t slots;
 
-	slots = device->port->regs->sact | device->port->regs->ci;
+	slots = device->port->regs->sact | device->port->regs->ci | device->failed;
 
-	for (i = 0; i < device->controller->command_slots; i++) {
+	for (i = 0; i < device->slots; i++) {
 		if ((slots & 0x1) == 0)
 			return i;
 
@@ -65,15 +72,44 @@ static int bl_ahci_find_free_command_slot(struct bl_ahci_device *device)
 	return -1;
 }
 
-static bl_status_t bl_ahci_do_command(struct bl_ahci_device *device, int command,
-		bl_uint8_t *buf, bl_uint64_t lba, bl_uint64_t sectors)
+static int bl_ahci_free_command_slots(struct bl_ahci_device *device)
 {
-	int i;
-	int slot;
+	int i, count;
+	bl_uint32_t slots;
+
+	slots = device->port->regs->sact | device->port->regs->ci | device->failed;
+
+	for (i = 0, count = 0; i < device->slots; i++, slots >>= 1)
+		if ((slots & 0x1) == 0)
+			count++;
+
+	return count;
+}
+
+static int bl_ahci_segment_prdt_entries(struct bl_storage_segment *segment)
+{
+	static const bl_uint64_t prdt_sectors = BL_AHCI_PRDT_MAX_DBC / BL_STORAGE_SECTOR_SIZE;
+
+	return segment->sectors / prdt_sectors + ((segment->sectors % prdt_sectors) > 0);
+}
+
+/* Segments are read by a single command, so they must be contiguous on the disk. */
+static bl_status_t bl_ahci_issue_command_sg(struct bl_ahci_device *device, int command,
+		bl_uint64_t lba, struct bl_storage_segment *segments, int count, int *issued_slot)
+{
+	int i, j;
+	int slot, prdtl;
+	bl_uint64_t sectors;
 	struct bl_ahci_fis_host_to_device *h2d;
+	volatile struct bl_ahci_prdt *prdt;
 	static const bl_uint64_t prdt_sectors = BL_AHCI_PRDT_MAX_DBC / BL_STORAGE_SECTOR_SIZE;
 
-	if (sectors > (BL_AHCI_PRDT_ENTRIES * prdt_sectors))
+	for (i = 0, prdtl = 0, sectors = 0; i < count; i++) {
+		prdtl += bl_ahci_segment_prdt_entries(&segments[i]);
+		sectors += segments[i].sectors;
+	}
+
+	if (prdtl > BL_AHCI_PRDT_ENTRIES || sectors > BL_AHCI_MAX_SECTORS)
 		return BL_STATUS_INVALID_PARAMETERS;
 
 	slot = bl_ahci_find_free_command_slot(device);
@@ -86,25 +122,29 @@ static bl_status_t bl_ahci_do_command(struct bl_ahci_device *device, int command
 
 	device->port->command_list[slot].w = 0;
 
-	device->port->command_list[slot].prdtl = sectors / prdt_sectors + ((sectors % prdt_sectors) > 0);
+	device->port->command_list[slot].prdtl = prdtl;
 
-	/* Set command table & PRDT. */
+	/* Set command table & PRDT - one or more entries for each segment. */
 	bl_memset((void *)&device->port->command_table[slot], 0, sizeof(struct bl_ahci_command_table));
 
-	bl_int64_t count = sectors;
-	bl_uint64_t off = 0;
+	prdt = device->port->command_table[slot].prdt;
+
+	for (i = 0; i < count; i++) {
+		bl_int64_t left = segments[i].sectors;
+		bl_uint64_t off = 0;
 
-	for (i = 0; i < device->port->command_list[slot].prdtl; i++) {
-		device->port->command_table[slot].prdt[i].dba = (bl_uint32_t)buf + off;
+		for (j = 0; j < bl_ahci_segment_prdt_entries(&segments[i]); j++, prdt++) {
+			prdt->dba = (bl_uint32_t)segments[i].buf + off;
 
-		int read_size = BL_MIN(count, prdt_sectors) * BL_STORAGE_SECTOR_SIZE;
+			int read_size = BL_MIN(left, prdt_sectors) * BL_STORAGE_SECTOR_SIZE;
 
-		device->port->command_table[slot].prdt[i].dbc = read_size - 1;
+			prdt->dbc = read_size - 1;
 
-		device->port->command_table[slot].prdt[i].i = 1;
+			prdt->i = 1;
 
-		off += read_size;
-		count -= prdt_sectors;
+			off += read_size;
+			left -= prdt_sectors;
+		}
 	}
 
 	/* Specific command. */
@@ -115,6 +155,27 @@ static bl_status_t bl_ahci_do_command(struct bl_ahci_device *device, int command
 
 	h2d->command = command;
 	switch (h2d->command) {
+	case BL_SATA_COMMAND_READ_FPDMA_QUEUED:
+		h2d->lba0 = lba & 0xff;
+		h2d->lba1 = (lba >> 8) & 0xff;
+		h2d->lba2 = (lba >> 16) & 0xff;
+		h2d->lba3 = (lba >> 24) & 0xff;
+		h2d->lba4 = (lba >> 32) & 0xff;
+		h2d->lba5 = (lba >> 40) & 0xff;
+
+		/* Sector count is passed in the features field. */
+		h2d->features0 = sectors & 0xff;
+		h2d->features1 = (sectors >> 8) & 0xff;
+
+		h2d->count0 = BL_SATA_FPDMA_TAG(slot);
+
+		h2d->device = (1 << 6); /* LBA */
+
+		/* Tag is active until the device sends Set Device Bits FIS. */
+		device->port->regs->sact = (1 << slot);
+
+		break;
+
 	case BL_SATA_COMMAND_READ_SECTORS_DMA_EXT:
 		h2d->lba0 = lba & 0xff;
 		h2d->lba1 = (lba >> 8) & 0xff;
@@ -136,20 +197,127 @@ static bl_status_t bl_ahci_do_command(struct bl_ahci_device *device, int command
 
 	device->port->regs->ci |= (1 << slot);
 
-	/* Status. */
-	int timeout = 100;
-	while (--timeout) {
-		if ((device->port->regs->ci & (1 << slot)) == 0)
-			break;
+	*issued_slot = slot;
+
+	return BL_STATUS_SUCCESS;
+}
+
+/*
+ * A task file error halts the port with the failed command, and the queued ones,
+ * left in PxCI/PxSACT. Restart the port and fail every command that was outstanding.
+ */
+static void bl_ahci_port_recover(struct bl_ahci_device *device)
+{
+	volatile struct bl_ahci_port_registers *regs;
+
+	regs = device->port->regs;
+
+	device->failed |= regs->sact | regs->ci;
+
+	/* Clearing ST also clears PxCI and PxSACT. */
+	regs->cmd &= ~BL_AHCI_PORT_CMD_ST;
+	bl_poll_until((regs->cmd & BL_AHCI_PORT_CMD_CR) == 0, 500000);
+
+	regs->serr = regs->serr;
+	regs->is = regs->is;
 
-		bl_time_sleep(1);
+	/* Device may still be busy with the failed command. */
+	if ((regs->tfd & (BL_AHCI_PORT_TFD_STS_DRQ | BL_AHCI_PORT_TFD_STS_BSY)) &&
+			(device->controller->ghc->cap & BL_AHCI_CAP_SCLO)) {
+		regs->cmd |= BL_AHCI_PORT_CMD_CLO;
+		bl_poll_until((regs->cmd & BL_AHCI_PORT_CMD_CLO) == 0, 500000);
 	}
 
-	if (device->port->regs->ci & (1 << slot))
-		return BL_STATUS_DISK_OPERATION_TIMEOUT;
+	regs->cmd |= BL_AHCI_PORT_CMD_ST;
+}
 
+static bl_status_t bl_ahci_command_status(struct bl_ahci_device *device, bl_uint32_t slots)
+{
 	if (device->port->regs->is & BL_AHCI_PORT_IS_TFES)
+		bl_ahci_port_recover(device);
+
+	if (device->failed & slots) {
+		device->failed &= ~slots;
 		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+	}
+
+	if ((device->port->regs->sact | device->port->regs->ci) & slots)
+		return BL_STATUS_DISK_OPERATION_NOT_FINISHED;
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_ahci_wait_commands(struct bl_ahci_device *device, bl_uint32_t slots)
+{
+	bl_status_t status;
+
+	/* Failed NCQ commands never leave PxSACT, stop waiting on the error. */
+	bl_poll_until(((device->port->regs->sact | device->port->regs->ci) & slots) == 0 ||
+			(device->port->regs->is & BL_AHCI_PORT_IS_TFES), BL_AHCI_COMMAND_TIMEOUT);
+
+	status = bl_ahci_command_status(device, slots);
+	if (status == BL_STATUS_DISK_OPERATION_NOT_FINISHED)
+		return BL_STATUS_DISK_OPERATION_TIMEOUT;
+
+	return status;
+}
+
+static bl_status_t bl_ahci_do_command_sg(struct bl_ahci_device *device, int command,
+		bl_uint64_t lba, struct bl_storage_segment *segments, int count)
+{
+	int slot;
+	bl_status_t status;
+
+	status = bl_ahci_issue_command_sg(device, command, lba, segments, count, &slot);
+	if (status)
+		return status;
+
+	return bl_ahci_wait_commands(device, 1 << slot);
+}
+
+/* Queued and non queued commands can't be mixed, so NCQ devices read only with FPDMA. */
+static inline int bl_ahci_read_command(struct bl_ahci_device *device)
+{
+	return device->ncq ? BL_SATA_COMMAND_READ_FPDMA_QUEUED :
+		BL_SATA_COMMAND_READ_SECTORS_DMA_EXT;
+}
+
+static bl_status_t bl_ahci_do_command(struct bl_ahci_device *device, int command,
+		bl_uint8_t *buf, bl_uint64_t lba, bl_uint64_t sectors)
+{
+	struct bl_storage_segment segment;
+
+	segment.lba = lba;
+	segment.sectors = sectors;
+	segment.buf = buf;
+
+	return bl_ahci_do_command_sg(device, command, lba, &segment, 1);
+}
+
+/* Issue a read of any size, split to commands of BL_AHCI_MAX_SECTORS in free slots. */
+static bl_status_t bl_ahci_issue_read(struct bl_ahci_device *device, bl_uint8_t *buf,
+		bl_uint64_t lba, bl_uint64_t sectors, bl_uint32_t *issued)
+{
+	int slot;
+	bl_status_t status;
+	struct bl_storage_segment segment;
+
+	while (sectors) {
+		segment.lba = lba;
+		segment.sectors = BL_MIN(sectors, BL_AHCI_MAX_SECTORS);
+		segment.buf = buf;
+
+		status = bl_ahci_issue_command_sg(device, bl_ahci_read_command(device), lba,
+				&segment, 1, &slot);
+		if (status)
+			return status;
+
+		*issued |= (1 << slot);
+
+		buf += segment.sectors * BL_STORAGE_SECTOR_SIZE;
+		lba += segment.sectors;
+		sectors -= segment.sectors;
+	}
 
 	return BL_STATUS_SUCCESS;
 }
@@ -157,19 +325,132 @@ static bl_status_t bl_ahci_do_command(struct bl_ahci_device *device, int command
 static bl_status_t bl_ahci_read(struct bl_storage_device *disk, bl_uint8_t *buf,
 		bl_uint64_t lba, bl_uint64_t sectors)
 {
+	bl_uint32_t issued;
+	bl_uint64_t chunk;
 	bl_status_t status;
 	struct bl_ahci_device *device;
 
 	device = disk->data;
 
-	status = bl_ahci_do_command(device, BL_SATA_COMMAND_READ_SECTORS_DMA_EXT, buf,
-			lba, sectors);
-	if (status)
+	while (sectors) {
+		/* Keep the transfer within the slots that are free right now. */
+		chunk = BL_MIN(sectors, bl_ahci_free_command_slots(device) *
+				(bl_uint64_t)BL_AHCI_MAX_SECTORS);
+		if (!chunk) {
+			/* Slots of other requests - leave their errors to their own waiters. */
+			if (!bl_poll_until(bl_ahci_free_command_slots(device) ||
+					(device->port->regs->is & BL_AHCI_PORT_IS_TFES),
+					BL_AHCI_COMMAND_TIMEOUT))
+				return BL_STATUS_DISK_OPERATION_TIMEOUT;
+
+			if (device->port->regs->is & BL_AHCI_PORT_IS_TFES)
+				bl_ahci_port_recover(device);
+
+			continue;
+		}
+
+		issued = 0;
+
+		status = bl_ahci_issue_read(device, buf, lba, chunk, &issued);
+		if (status) {
+			bl_ahci_wait_commands(device, issued);
+			return status;
+		}
+
+		status = bl_ahci_wait_commands(device, issued);
+		if (status)
+			return status;
+
+		buf += chunk * BL_STORAGE_SECTOR_SIZE;
+		lba += chunk;
+		sectors -= chunk;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_ahci_readv(struct bl_storage_device *disk,
+		struct bl_storage_segment *segments, int count)
+{
+	int i, j;
+	int prdtl;
+	bl_uint64_t sectors;
+	bl_status_t status;
+	struct bl_ahci_device *device;
+
+	device = disk->data;
+
+	for (i = 0; i < count; i = j) {
+		prdtl = bl_ahci_segment_prdt_entries(&segments[i]);
+		sectors = segments[i].sectors;
+
+		/* Too large for one command. */
+		if (sectors > BL_AHCI_MAX_SECTORS || prdtl > BL_AHCI_PRDT_ENTRIES) {
+			status = bl_ahci_read(disk, segments[i].buf, segments[i].lba, sectors);
+			if (status)
+				return status;
+
+			j = i + 1;
+			continue;
+		}
+
+		/* Merge segments that continue each other on the disk into one command. */
+		for (j = i + 1; j < count; j++) {
+			if (segments[j].lba != segments[j - 1].lba + segments[j - 1].sectors)
+				break;
+
+			if (prdtl + bl_ahci_segment_prdt_entries(&segments[j]) > BL_AHCI_PRDT_ENTRIES)
+				break;
+
+			if (sectors + segments[j].sectors > BL_AHCI_MAX_SECTORS)
+				break;
+
+			prdtl += bl_ahci_segment_prdt_entries(&segments[j]);
+			sectors += segments[j].sectors;
+		}
+
+		status = bl_ahci_do_command_sg(device, bl_ahci_read_command(device),
+				segments[i].lba, &segments[i], j - i);
+		if (status)
+			return status;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_ahci_submit(struct bl_storage_device *disk,
+		struct bl_storage_request *request)
+{
+	bl_status_t status;
+	bl_uint64_t commands;
+	struct bl_ahci_device *device;
+
+	device = disk->data;
+
+	/* All commands of the request are issued at once - tag holds their slots. */
+	commands = request->sectors / BL_AHCI_MAX_SECTORS +
+		((request->sectors % BL_AHCI_MAX_SECTORS) > 0);
+	if (commands > bl_ahci_free_command_slots(device))
+		return BL_STATUS_INSUFFICIENT_RESOURCES;
+
+	request->tag = 0;
+
+	status = bl_ahci_issue_read(device, request->buf, request->lba, request->sectors,
+			&request->tag);
+	if (status) {
+		bl_ahci_wait_commands(device, request->tag);
 		return status;
+	}
 
 	return BL_STATUS_SUCCESS;
 }
 
+static bl_status_t bl_ahci_poll(struct bl_storage_device *disk,
+		struct bl_storage_request *request)
+{
+	return bl_ahci_command_status(disk->data, request->tag);
+}
+
 static bl_status_t bl_ahci_identify_device(struct bl_ahci_device *device)
 {
 	bl_status_t status;
@@ -178,13 +459,36 @@ static bl_status_t bl_ahci_identify_device(struct bl_ahci_device *device)
 	if (status)
 		return status;
 
+	/* Both HBA and device must support NCQ. */
+	if ((device->controller->ghc->cap & BL_AHCI_CAP_SNCQ) &&
+			(device->id.sata_capabilities & BL_SATA_ID_SATA_CAP_NCQ)) {
+		device->ncq = 1;
+		device->slots = BL_MIN(device->slots, BL_SATA_ID_QUEUE_DEPTH(&device->id));
+	}
+
 	return BL_STATUS_SUCCESS;
 }
 
+/* All attached devices finished spinning up. */
+static int bl_ahci_devices_ready(struct bl_ahci_controller *ahci)
+{
+	int i;
+
+	for (i = 0; i < ahci->number_of_ports; i++)
+		if (ahci->ports[i].implemented && (ahci->port_regs[i].tfd &
+				(BL_AHCI_PORT_TFD_STS_DRQ | BL_AHCI_PORT_TFD_STS_BSY)))
+			return 0;
+
+	return 1;
+}
+
 static bl_status_t bl_ahci_detect_devices(struct bl_ahci_controller *ahci)
 {
 	int i;
 
+	/* Spin up happens in parallel, so wait once for all the ports. */
+	bl_poll_until(bl_ahci_devices_ready(ahci), BL_AHCI_SPIN_UP_TIMEOUT);
+
 	/* Enable ports again. */
 	for (i = 0; i < ahci->number_of_ports; i++) {
 		if (!ahci->ports[i].implemented)
@@ -200,6 +504,9 @@ static bl_status_t bl_ahci_detect_devices(struct bl_ahci_controller *ahci)
 
 			device->port = &ahci->ports[i];
 			device->controller = ahci;
+			device->ncq = 0;
+			device->failed = 0;
+			device->slots = ahci->command_slots;
 
 			bl_ahci_identify_device(device);
 
@@ -210,6 +517,35 @@ static bl_status_t bl_ahci_detect_devices(struct bl_ahci_controller *ahci)
 	return BL_STATUS_SUCCESS;
 }
 
+/* None of the ports has any of the flags set in PxCMD. */
+static int bl_ahci_ports_clear(struct bl_ahci_controller *ahci, bl_uint32_t flags)
+{
+	int i;
+
+	for (i = 0; i < ahci->number_of_ports; i++)
+		if (ahci->ports[i].implemented && (ahci->port_regs[i].cmd & flags))
+			return 0;
+
+	return 1;
+}
+
+/* Every port has an established link, or was taken offline. */
+static int bl_ahci_links_settled(struct bl_ahci_controller *ahci)
+{
+	int i, det;
+
+	for (i = 0; i < ahci->number_of_ports; i++) {
+		if (!ahci->ports[i].implemented)
+			continue;
+
+		det = BL_AHCI_PORT_STSS_DET(ahci->port_regs[i].ssts);
+		if (det != BL_AHCI_PORT_SSTS_DET_PRESENT_PHYS && det != BL_AHCI_PORT_SSTS_DET_OFFLINE)
+			return 0;
+	}
+
+	return 1;
+}
+
 static bl_status_t bl_ahci_controller_init(struct bl_ahci_controller *ahci)
 {
 	int i, j;
@@ -221,15 +557,7 @@ static bl_status_t bl_ahci_controller_init(struct bl_ahci_controller *ahci)
 	/* Perform reset. */
 	ahci->ghc->ghc |= BL_AHCI_GHC_HR;
 
-	int timeout = 1000;
-	while (--timeout) {
-		if ((ahci->ghc->ghc & BL_AHCI_GHC_HR) == 0)
-			break;
-
-		bl_time_sleep(1);
-	}
-
-	if (ahci->ghc->ghc & BL_AHCI_GHC_HR)
+	if (!bl_poll_until((ahci->ghc->ghc & BL_AHCI_GHC_HR) == 0, 1000000))
 		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
 
 	/* AHCI aware again ? */
@@ -243,31 +571,40 @@ static bl_status_t bl_ahci_controller_init(struct bl_ahci_controller *ahci)
 
 	ahci->port_regs = (bl_uint8_t *)ahci->ghc + 0x100;
 
-	for (i = 0; i < ahci->number_of_ports; i++) {
-		if ((ahci->ghc->pi & (1 << i)) == 0) {
-			ahci->ports[i].implemented = 0;
-			continue;
-		}
+	for (i = 0; i < ahci->number_of_ports; i++)
+		ahci->ports[i].implemented = (ahci->ghc->pi & (1 << i)) != 0;
 
-		if (ahci->port_regs[i].cmd & (BL_AHCI_PORT_CMD_ST | BL_AHCI_PORT_CMD_FRE |
-					BL_AHCI_PORT_CMD_FR | BL_AHCI_PORT_CMD_CR)) {
+	/* Stop all ports, and wait for them together. */
+	for (i = 0; i < ahci->number_of_ports; i++)
+		if (ahci->ports[i].implemented)
 			ahci->port_regs[i].cmd &= ~BL_AHCI_PORT_CMD_ST;
-			bl_time_sleep(500);
 
-			if (ahci->port_regs[i].cmd & BL_AHCI_PORT_CMD_CR)
-				return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+	if (!bl_poll_until(bl_ahci_ports_clear(ahci, BL_AHCI_PORT_CMD_CR), 500000))
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
 
-			if (ahci->port_regs[i].cmd & BL_AHCI_PORT_CMD_FRE) {
-				ahci->port_regs[i].cmd &= ~BL_AHCI_PORT_CMD_FRE;
-				bl_time_sleep(500);
+	for (i = 0; i < ahci->number_of_ports; i++)
+		if (ahci->ports[i].implemented)
+			ahci->port_regs[i].cmd &= ~BL_AHCI_PORT_CMD_FRE;
 
-				if (ahci->port_regs[i].cmd & BL_AHCI_PORT_CMD_FR)
-					return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
-			}
-		}
+	if (!bl_poll_until(bl_ahci_ports_clear(ahci, BL_AHCI_PORT_CMD_FR), 500000))
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
 
-		ahci->ports[i].implemented = 1;
-	}
+	/* With staggered spin up the link comes up only after SUD, so spin up all ports at once. */
+	if (ahci->ghc->cap & BL_AHCI_CAP_SSS)
+		for (i = 0; i < ahci->number_of_ports; i++)
+			if (ahci->ports[i].implemented)
+				ahci->port_regs[i].cmd |= BL_AHCI_PORT_CMD_SUD;
+
+	/*
+	 * Drop ports without an established link - they aren't worth any memory. A device
+	 * may show up late, so empty ports are dropped only when the deadline expires.
+	 */
+	bl_poll_until(bl_ahci_links_settled(ahci), BL_AHCI_LINK_TIMEOUT);
+
+	for (i = 0; i < ahci->number_of_ports; i++)
+		if (ahci->ports[i].implemented && BL_AHCI_PORT_STSS_DET(ahci->port_regs[i].ssts) !=
+				BL_AHCI_PORT_SSTS_DET_PRESENT_PHYS)
+			ahci->ports[i].implemented = 0;
 
 	/* Number of command slots. */
 	ahci->command_slots = 1 + BL_AHCI_CAP_NCS(ahci->ghc->cap);
@@ -354,14 +691,19 @@ static bl_status_t bl_ahci_pci_initialize(struct bl_pci_index i)
 static struct bl_disk_controller_functions ahci_functions = {
 	.type = BL_DISK_CONTROLLER_TYPE_AHCI,
 	.read = bl_ahci_read,
+	.readv = bl_ahci_readv,
+	.submit = bl_ahci_submit,
+	.poll = bl_ahci_poll,
 	.get_info = NULL,
 };
 
 BL_MODULE_INIT()
 {
+	bl_uint64_t stamp;
 	struct bl_ahci_device *device;
 	struct bl_disk_controller *controller;
 
+	stamp = bl_time_stamp();
 	bl_pci_iterate_devices(bl_ahci_pci_initialize);
 
 	controller = bl_heap_alloc(sizeof(struct bl_disk_controller));
@@ -370,6 +712,7 @@ BL_MODULE_INIT()
 
 	controller->funcs = &ahci_functions;
 	controller->data = NULL;
+	controller->probe_us = bl_time_elapsed_us(stamp);
 	controller->next = NULL;
 
 	bl_disk_controller_register(controller);
@@ -391,6 +734,10 @@ BL_MODULE_INIT()
 
 		bl_storage_device_register(disk);
 
+		/* Let the block layer keep every NCQ tag busy. */
+		if (device->ncq)
+			bl_storage_device_set_queue_depth(disk, device->slots);
+
 		device = device->next;
 	}
 }
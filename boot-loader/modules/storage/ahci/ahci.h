@@ -15,7 +15,10 @@ enum {
 
 /* AHCI CHG capabilities */
 enum {
-	BL_AHCI_CAP_NP	= (0x1f << 0),
+	BL_AHCI_CAP_NP		= (0x1f << 0),
+	BL_AHCI_CAP_SCLO	= (1 << 24),
+	BL_AHCI_CAP_SSS		= (1 << 27),
+	BL_AHCI_CAP_SNCQ	= (1 << 30),
 };
 
 #define BL_AHCI_CAP_NCS(cap)	((cap >> 8) & 0x1f)
@@ -49,6 +52,8 @@ enum {
 /* AHCI PxCMD. */
 enum {
 	BL_AHCI_PORT_CMD_ST	= (1 << 0),
+	BL_AHCI_PORT_CMD_SUD	= (1 << 1),
+	BL_AHCI_PORT_CMD_CLO	= (1 << 3),
 	BL_AHCI_PORT_CMD_FRE	= (1 << 4),
 	BL_AHCI_PORT_CMD_FR	= (1 << 14),
 	BL_AHCI_PORT_CMD_CR	= (1 << 15),
@@ -63,7 +68,10 @@ enum {
 
 /* AHCI PxSTSS. */
 enum {
+	BL_AHCI_PORT_SSTS_DET_NONE		= 0x0,
+	BL_AHCI_PORT_SSTS_DET_PRESENT		= 0x1,
 	BL_AHCI_PORT_SSTS_DET_PRESENT_PHYS	= 0x3,
+	BL_AHCI_PORT_SSTS_DET_OFFLINE		= 0x4,
 };
 
 #define BL_AHCI_PORT_STSS_DET(ssts)	(ssts & 0xf)
@@ -122,8 +130,21 @@ struct bl_ahci_prdt {
 	__u32	i : 1;
 } __attribute__((packed));
 
-/* AHCI Command table. Pointed by the command header. */
-#define BL_AHCI_PRDT_ENTRIES	8
+/* AHCI Command table. Pointed by the command header. Keeps 128 bytes alignment. */
+#define BL_AHCI_PRDT_ENTRIES	64
+
+/* Largest transfer of a single READ DMA EXT/READ FPDMA QUEUED command. */
+#define BL_AHCI_MAX_SECTORS	0xffff
+
+/* Microseconds to wait for issued commands. */
+#define BL_AHCI_COMMAND_TIMEOUT	1000000
+
+/*
+ * Microseconds to wait for link negotiation & device spin up, on all ports at once.
+ * Link wait is the 10 ms AHCI gives the PHY to reach DET 3.
+ */
+#define BL_AHCI_LINK_TIMEOUT		10000
+#define BL_AHCI_SPIN_UP_TIMEOUT		1000000
 
 struct bl_ahci_command_table {
 	__u8	cfis[0x40];
@@ -145,8 +166,12 @@ enum {
 enum {
 	BL_SATA_COMMAND_IDENTIFY		= 0xec,
 	BL_SATA_COMMAND_READ_SECTORS_DMA_EXT	= 0x25,
+	BL_SATA_COMMAND_READ_FPDMA_QUEUED	= 0x60,
 };
 
+/* NCQ tag is placed in bits 7:3 of the count field. */
+#define BL_SATA_FPDMA_TAG(tag)	((tag) << 3)
+
 struct bl_ahci_fis_host_to_device {
 	__u8	fis_type;
 	__u8	pm_port : 4;
@@ -279,10 +304,16 @@ struct bl_sata_identification {
         __u32   capabilities;                           /* Word 49-50 */
         __u16   unused3[9];
         __u32   sectors_lba28;                          /* Word 60-61 */
-        __u16   unused4[38];
+        __u16   unused4[13];
+        __u16   queue_depth;                            /* Word 75 */
+        __u16   sata_capabilities;                      /* Word 76 */
+        __u16   unused5[23];
         __u64   sectors_lba48;                          /* Word 100-103 */
-        __u16   unused5[152];
+        __u16   unused6[152];
 } __attribute__((packed));
 
+#define BL_SATA_ID_QUEUE_DEPTH(id)	(((id)->queue_depth & 0x1f) + 1)
+#define BL_SATA_ID_SATA_CAP_NCQ		(1 << 8)
+
 #endif
 
@@ -0,0 +1,202 @@
+#include "int13.h"
+#include "include/string.h"
+#include "include/bl-utils.h"
+#include "core/include/loader/loader.h"
+#include "core/include/storage/storage.h"
+#include "core/include/memory/heap.h"
+#include "core/arch/i386/real-mode/include/bios.h"
+#include "core/arch/i386/real-mode/include/eflags.h"
+
+BL_MODULE_NAME("BIOS Int 13h Disk");
+
+struct bl_int13_drive {
+	bl_uint8_t number;
+
+	/* Lowered when the BIOS rejects a transfer of this size. */
+	bl_uint16_t max_sectors;
+};
+
+static bl_uint8_t *bl_int13_bounce = (bl_uint8_t *)BL_INT13_BOUNCE_ADDRESS;
+
+static bl_status_t bl_int13_check_extensions(bl_uint8_t number)
+{
+	struct bl_bios_registers iregs, oregs;
+
+	bl_bios_init_registers(&iregs);
+	iregs.ah = BL_INT13_FUNCTION_CHECK_EXTENSIONS;
+	iregs.bx = BL_INT13_CHECK_EXTENSIONS_MAGIC;
+	iregs.dl = number;
+
+	bl_bios_interrupt(0x13, &iregs, &oregs);
+
+	if ((oregs.eflags & BL_X86_EFLAGS_CF) ||
+			oregs.bx != BL_INT13_CHECK_EXTENSIONS_SIGNATURE ||
+			!(oregs.cx & BL_INT13_EXTENSIONS_PACKET_ACCESS))
+		return BL_STATUS_UNSUPPORTED;
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_int13_get_parameters(bl_uint8_t number,
+	struct bl_int13_drive_parameters *params)
+{
+	struct bl_bios_registers iregs, oregs;
+
+	bl_memset(params, 0, sizeof(struct bl_int13_drive_parameters));
+	params->size = sizeof(struct bl_int13_drive_parameters);
+
+	bl_bios_init_registers(&iregs);
+	iregs.ah = BL_INT13_FUNCTION_GET_DRIVE_PARAMETERS;
+	iregs.dl = number;
+	iregs.ds = BL_BIOS_PM_TO_RM_SEGMENT((bl_uint32_t)params);
+	iregs.si = BL_BIOS_PM_TO_RM_OFFSET((bl_uint32_t)params);
+
+	bl_bios_interrupt(0x13, &iregs, &oregs);
+
+	if (oregs.eflags & BL_X86_EFLAGS_CF)
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+
+	return BL_STATUS_SUCCESS;
+}
+
+/* Read into the bounce buffer. The packet has to live under 1 MiB, the stack does. */
+static bl_status_t bl_int13_extended_read(struct bl_int13_drive *drive, bl_uint64_t lba,
+	bl_uint16_t sectors)
+{
+	struct bl_int13_dap dap;
+	struct bl_bios_registers iregs, oregs;
+
+	dap.size = sizeof(struct bl_int13_dap);
+	dap.reserved = 0;
+	dap.sectors = sectors;
+	dap.segment = BL_BIOS_PM_TO_RM_SEGMENT((bl_uint32_t)bl_int13_bounce);
+	dap.offset = BL_BIOS_PM_TO_RM_OFFSET((bl_uint32_t)bl_int13_bounce);
+	dap.lba = lba;
+
+	bl_bios_init_registers(&iregs);
+	iregs.ah = BL_INT13_FUNCTION_EXTENDED_READ;
+	iregs.dl = drive->number;
+	iregs.ds = BL_BIOS_PM_TO_RM_SEGMENT((bl_uint32_t)&dap);
+	iregs.si = BL_BIOS_PM_TO_RM_OFFSET((bl_uint32_t)&dap);
+
+	bl_bios_interrupt(0x13, &iregs, &oregs);
+
+	if (oregs.eflags & BL_X86_EFLAGS_CF)
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_int13_read(struct bl_storage_device *disk, bl_uint8_t *buf,
+	bl_uint64_t lba, bl_uint64_t sectors)
+{
+	bl_uint16_t count;
+	bl_status_t status;
+	struct bl_int13_drive *drive;
+
+	drive = disk->data;
+
+	/* Each BIOS call is a round trip to real mode - move as much as the BIOS takes. */
+	while (sectors) {
+		count = BL_MIN(sectors, drive->max_sectors);
+
+		status = bl_int13_extended_read(drive, lba, count);
+		if (status) {
+			if (count == 1)
+				return status;
+
+			drive->max_sectors = count / 2;
+			continue;
+		}
+
+		bl_memcpy(buf, bl_int13_bounce, count * BL_STORAGE_SECTOR_SIZE);
+
+		buf += count * BL_STORAGE_SECTOR_SIZE;
+		lba += count;
+		sectors -= count;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+static struct bl_disk_controller_functions int13_functions = {
+	.type = BL_DISK_CONTROLLER_TYPE_BIOS_INT13,
+	.read = bl_int13_read,
+	.readv = NULL,
+	.submit = NULL,
+	.poll = NULL,
+	.get_info = NULL,
+};
+
+static bl_status_t bl_int13_register(struct bl_disk_controller *controller, bl_uint8_t number)
+{
+	struct bl_int13_drive_parameters params;
+	struct bl_int13_drive *drive;
+	struct bl_storage_device *disk;
+
+	if (bl_int13_check_extensions(number))
+		return BL_STATUS_UNSUPPORTED;
+
+	if (bl_int13_get_parameters(number, &params))
+		return BL_STATUS_UNSUPPORTED;
+
+	if (params.bytes_per_sector != BL_STORAGE_SECTOR_SIZE || !params.sectors)
+		return BL_STATUS_UNSUPPORTED;
+
+	drive = bl_heap_alloc(sizeof(struct bl_int13_drive));
+	if (!drive)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	drive->number = number;
+	drive->max_sectors = BL_INT13_MAX_SECTORS;
+
+	disk = bl_heap_alloc(sizeof(struct bl_storage_device));
+	if (!disk) {
+		bl_heap_free(drive, sizeof(struct bl_int13_drive));
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+	}
+
+	disk->type = BL_STORAGE_TYPE_HARD_DRIVE;
+	disk->controller = controller;
+	disk->sector_size = BL_STORAGE_SECTOR_SIZE;
+	disk->sector_count = params.sectors;
+	disk->data = drive;
+	disk->next = NULL;
+
+	bl_storage_device_register(disk);
+
+	return BL_STATUS_SUCCESS;
+}
+
+BL_MODULE_INIT()
+{
+	int number;
+	struct bl_disk_controller *controller;
+
+	/*
+	 * Fallback only - native drivers loaded earlier own their disks, and the BIOS
+	 * can't be trusted with a controller they have reprogrammed.
+	 */
+	if (bl_storage_device_get(0))
+		return;
+
+	controller = bl_heap_alloc(sizeof(struct bl_disk_controller));
+	if (!controller)
+		return;
+
+	controller->funcs = &int13_functions;
+	controller->data = NULL;
+	controller->probe_us = 0;
+	controller->next = NULL;
+
+	bl_disk_controller_register(controller);
+
+	for (number = BL_INT13_FIRST_DRIVE; number <= BL_INT13_LAST_DRIVE; number++)
+		if (bl_int13_register(controller, number) == BL_STATUS_MEMORY_ALLOCATION_FAILED)
+			break;
+}
+
+BL_MODULE_UNINIT()
+{
+
+}
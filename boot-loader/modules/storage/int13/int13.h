@@ -0,0 +1,53 @@
+#ifndef BL_INT13_H
+#define BL_INT13_H
+
+#include "include/bl-types.h"
+
+/* Int 13h extensions (EDD). */
+enum {
+	BL_INT13_FUNCTION_CHECK_EXTENSIONS	= 0x41,
+	BL_INT13_FUNCTION_EXTENDED_READ		= 0x42,
+	BL_INT13_FUNCTION_GET_DRIVE_PARAMETERS	= 0x48,
+};
+
+#define BL_INT13_CHECK_EXTENSIONS_MAGIC		0x55aa
+#define BL_INT13_CHECK_EXTENSIONS_SIGNATURE	0xaa55
+
+/* Extension subsets (CX of function 41h). */
+#define BL_INT13_EXTENSIONS_PACKET_ACCESS	(1 << 0)
+
+/* Disk address packet. */
+struct bl_int13_dap {
+	__u8	size;
+	__u8	reserved;
+	__u16	sectors;
+	__u16	offset;
+	__u16	segment;
+	__u64	lba;
+} __attribute__((packed));
+
+/* Result buffer of function 48h. */
+struct bl_int13_drive_parameters {
+	__u16	size;
+	__u16	flags;
+	__u32	cylinders;
+	__u32	heads;
+	__u32	sectors_per_track;
+	__u64	sectors;
+	__u16	bytes_per_sector;
+} __attribute__((packed));
+
+/* Hard disk numbers probed. */
+#define BL_INT13_FIRST_DRIVE	0x80
+#define BL_INT13_LAST_DRIVE	0x8f
+
+/* Largest transfer many BIOSes accept in a single packet. */
+#define BL_INT13_MAX_SECTORS	127
+
+/*
+ * Bounce buffer in conventional memory, between the loaded image and the EBDA.
+ * 127 sectors fit in its single 64 KiB segment.
+ */
+#define BL_INT13_BOUNCE_ADDRESS	0x70000
+
+#endif
@@ -0,0 +1,720 @@
+#include "nvme.h"
+#include "include/time.h"
+#include "include/string.h"
+#include "include/bl-utils.h"
+#include "core/include/loader/loader.h"
+#include "core/include/storage/storage.h"
+#include "core/include/pci/pci.h"
+#include "core/include/memory/heap.h"
+#include "core/include/video/print.h"
+
+BL_MODULE_NAME("NVM Express");
+
+/*
+ * Submission/completion queue pair. Command IDs double as SQ slots - at most
+ * size - 1 commands are outstanding, so the SQ can never overflow.
+ */
+struct bl_nvme_queue {
+	int id;
+	int size;
+
+	volatile struct bl_nvme_sq_entry *sq;
+	volatile struct bl_nvme_cq_entry *cq;
+
+	int sq_tail;
+	int cq_head;
+	int phase;
+
+	volatile bl_uint32_t *sq_doorbell;
+	volatile bl_uint32_t *cq_doorbell;
+
+	/* Command IDs issued & those that completed with an error. */
+	bl_uint32_t busy;
+	bl_uint32_t failed;
+
+	/* PRP list page of each command ID. */
+	bl_uint64_t *prp_lists;
+};
+
+struct bl_nvme_controller {
+	volatile struct bl_nvme_registers *regs;
+	int doorbell_stride;
+
+	/* Largest transfer of a single command, in bytes. */
+	bl_size_t max_transfer;
+
+	struct bl_nvme_queue admin;
+
+	int io_queue_count;
+	struct bl_nvme_queue *io_queues;
+};
+
+struct bl_nvme_namespace {
+	int nsid;
+	bl_uint64_t sectors;
+
+	struct bl_nvme_controller *controller;
+	struct bl_nvme_queue *queue;
+
+	struct bl_nvme_namespace *next;
+};
+static struct bl_nvme_namespace *bl_nvme_namespace_list = NULL;
+
+static inline void bl_nvme_namespace_add(struct bl_nvme_namespace *ns)
+{
+	ns->next = bl_nvme_namespace_list;
+	bl_nvme_namespace_list = ns;
+}
+
+static inline volatile bl_uint32_t *bl_nvme_doorbell(struct bl_nvme_controller *nvme, int index)
+{
+	return (volatile bl_uint32_t *)((bl_uint8_t *)nvme->regs + BL_NVME_DOORBELL_BASE +
+		index * nvme->doorbell_stride);
+}
+
+static bl_status_t bl_nvme_queue_init(struct bl_nvme_controller *nvme, struct bl_nvme_queue *queue,
+	int id, int size, int prp_lists)
+{
+	queue->id = id;
+	queue->size = size;
+	queue->sq_tail = 0;
+	queue->cq_head = 0;
+	queue->phase = 1;
+	queue->busy = 0;
+	queue->failed = 0;
+	queue->prp_lists = NULL;
+
+	queue->sq = bl_heap_alloc_align(BL_NVME_PAGE_SIZE, BL_NVME_PAGE_SIZE);
+	if (!queue->sq)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	queue->cq = bl_heap_alloc_align(BL_NVME_PAGE_SIZE, BL_NVME_PAGE_SIZE);
+	if (!queue->cq)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	bl_memset((void *)queue->sq, 0, BL_NVME_PAGE_SIZE);
+	bl_memset((void *)queue->cq, 0, BL_NVME_PAGE_SIZE);
+
+	if (prp_lists) {
+		queue->prp_lists = bl_heap_alloc_align((size - 1) * BL_NVME_PAGE_SIZE,
+			BL_NVME_PAGE_SIZE);
+		if (!queue->prp_lists)
+			return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+	}
+
+	queue->sq_doorbell = bl_nvme_doorbell(nvme, 2 * id);
+	queue->cq_doorbell = bl_nvme_doorbell(nvme, 2 * id + 1);
+
+	return BL_STATUS_SUCCESS;
+}
+
+/* Take everything the controller posted, the phase bit flips on every wrap. */
+static void bl_nvme_queue_reap(struct bl_nvme_queue *queue)
+{
+	int reaped;
+	volatile struct bl_nvme_cq_entry *entry;
+
+	for (reaped = 0; ; reaped = 1) {
+		entry = &queue->cq[queue->cq_head];
+		if ((entry->status & BL_NVME_CQ_STATUS_PHASE) != queue->phase)
+			break;
+
+		queue->busy &= ~(1 << entry->cid);
+		if (BL_NVME_CQ_STATUS_CODE(entry->status))
+			queue->failed |= (1 << entry->cid);
+
+		if (++queue->cq_head == queue->size) {
+			queue->cq_head = 0;
+			queue->phase = !queue->phase;
+		}
+	}
+
+	if (reaped)
+		*queue->cq_doorbell = queue->cq_head;
+}
+
+static int bl_nvme_find_free_cid(struct bl_nvme_queue *queue)
+{
+	int i;
+
+	for (i = 0; i < queue->size - 1; i++)
+		if (!((queue->busy | queue->failed) & (1 << i)))
+			return i;
+
+	return -1;
+}
+
+static int bl_nvme_free_cids(struct bl_nvme_queue *queue)
+{
+	int i, count;
+
+	for (i = 0, count = 0; i < queue->size - 1; i++)
+		if (!((queue->busy | queue->failed) & (1 << i)))
+			count++;
+
+	return count;
+}
+
+/* Doesn't touch the failed IDs, their requests still have to see the error. */
+static int bl_nvme_cid_available(struct bl_nvme_queue *queue)
+{
+	bl_nvme_queue_reap(queue);
+
+	return bl_nvme_free_cids(queue) > 0;
+}
+
+/* Describe the buffer with PRP entries, pages past the second one go to the list of the cid. */
+static void bl_nvme_build_prp(struct bl_nvme_queue *queue, int cid,
+	struct bl_nvme_sq_entry *command, bl_uint8_t *buf, bl_size_t length)
+{
+	int i;
+	bl_size_t first;
+	bl_addr_t page;
+	bl_uint64_t *list;
+
+	command->prp1 = (bl_addr_t)buf;
+	command->prp2 = 0;
+
+	if (!length)
+		return;
+
+	first = BL_NVME_PAGE_SIZE - ((bl_addr_t)buf & (BL_NVME_PAGE_SIZE - 1));
+	if (length <= first)
+		return;
+
+	page = (bl_addr_t)buf + first;
+	length -= first;
+
+	if (length <= BL_NVME_PAGE_SIZE) {
+		command->prp2 = page;
+		return;
+	}
+
+	list = queue->prp_lists + cid * BL_NVME_PRP_ENTRIES;
+	for (i = 0; length; i++) {
+		list[i] = page;
+
+		page += BL_NVME_PAGE_SIZE;
+		length -= BL_MIN(length, BL_NVME_PAGE_SIZE);
+	}
+
+	command->prp2 = (bl_addr_t)list;
+}
+
+static bl_status_t bl_nvme_issue_command(struct bl_nvme_queue *queue,
+	struct bl_nvme_sq_entry *command, void *buf, bl_size_t length, int *issued_cid)
+{
+	int cid;
+
+	bl_nvme_queue_reap(queue);
+
+	cid = bl_nvme_find_free_cid(queue);
+	if (cid < 0)
+		return BL_STATUS_INSUFFICIENT_RESOURCES;
+
+	command->cid = cid;
+	bl_nvme_build_prp(queue, cid, command, buf, length);
+	bl_memcpy((void *)&queue->sq[queue->sq_tail], command, sizeof(struct bl_nvme_sq_entry));
+
+	queue->busy |= (1 << cid);
+
+	if (++queue->sq_tail == queue->size)
+		queue->sq_tail = 0;
+
+	*queue->sq_doorbell = queue->sq_tail;
+
+	*issued_cid = cid;
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_nvme_command_status(struct bl_nvme_queue *queue, bl_uint32_t cids)
+{
+	bl_nvme_queue_reap(queue);
+
+	if (queue->busy & cids)
+		return BL_STATUS_DISK_OPERATION_NOT_FINISHED;
+
+	if (queue->failed & cids) {
+		queue->failed &= ~cids;
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_nvme_wait_commands(struct bl_nvme_queue *queue, bl_uint32_t cids)
+{
+	bl_status_t status;
+
+	if (!bl_poll_until((status = bl_nvme_command_status(queue, cids)) !=
+				BL_STATUS_DISK_OPERATION_NOT_FINISHED, BL_NVME_COMMAND_TIMEOUT))
+		return BL_STATUS_DISK_OPERATION_TIMEOUT;
+
+	return status;
+}
+
+/* Admin command buffers are single pages, they never need a PRP list. */
+static bl_status_t bl_nvme_admin_command(struct bl_nvme_controller *nvme,
+	struct bl_nvme_sq_entry *command, void *buf, bl_uint32_t *result)
+{
+	int cid;
+	bl_status_t status;
+	struct bl_nvme_queue *queue;
+
+	queue = &nvme->admin;
+
+	status = bl_nvme_issue_command(queue, command, buf, buf ? BL_NVME_PAGE_SIZE : 0, &cid);
+	if (status)
+		return status;
+
+	status = bl_nvme_wait_commands(queue, 1 << cid);
+	if (status)
+		return status;
+
+	/* Entry before the head is the one just reaped. */
+	if (result)
+		*result = queue->cq[(queue->cq_head + queue->size - 1) % queue->size].dw0;
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_nvme_identify(struct bl_nvme_controller *nvme, int cns, int nsid,
+	void *buf)
+{
+	struct bl_nvme_sq_entry command;
+
+	bl_memset(&command, 0, sizeof(struct bl_nvme_sq_entry));
+
+	command.opcode = BL_NVME_ADMIN_IDENTIFY;
+	command.nsid = nsid;
+	command.cdw10 = cns;
+
+	return bl_nvme_admin_command(nvme, &command, buf, NULL);
+}
+
+/* Issue a read of any size, split to commands of max_transfer bytes. */
+static bl_status_t bl_nvme_issue_read(struct bl_nvme_namespace *ns, bl_uint8_t *buf,
+	bl_uint64_t lba, bl_uint64_t sectors, bl_uint32_t *issued)
+{
+	int cid;
+	bl_uint64_t count;
+	bl_status_t status;
+	struct bl_nvme_sq_entry command;
+
+	while (sectors) {
+		count = BL_MIN(sectors, ns->controller->max_transfer / BL_STORAGE_SECTOR_SIZE);
+
+		bl_memset(&command, 0, sizeof(struct bl_nvme_sq_entry));
+
+		command.opcode = BL_NVME_NVM_READ;
+		command.nsid = ns->nsid;
+		command.cdw10 = lba & 0xffffffff;
+		command.cdw11 = lba >> 32;
+		command.cdw12 = count - 1;
+
+		status = bl_nvme_issue_command(ns->queue, &command, buf, count * BL_STORAGE_SECTOR_SIZE,
+			&cid);
+		if (status)
+			return status;
+
+		*issued |= (1 << cid);
+
+		buf += count * BL_STORAGE_SECTOR_SIZE;
+		lba += count;
+		sectors -= count;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_nvme_read(struct bl_storage_device *disk, bl_uint8_t *buf,
+	bl_uint64_t lba, bl_uint64_t sectors)
+{
+	bl_uint32_t issued;
+	bl_uint64_t chunk, max_sectors;
+	bl_status_t status;
+	struct bl_nvme_namespace *ns;
+
+	ns = disk->data;
+	max_sectors = ns->controller->max_transfer / BL_STORAGE_SECTOR_SIZE;
+
+	while (sectors) {
+		/* Keep the transfer within the command IDs that are free right now. */
+		bl_nvme_queue_reap(ns->queue);
+
+		chunk = BL_MIN(sectors, bl_nvme_free_cids(ns->queue) * max_sectors);
+		if (!chunk) {
+			/* Every ID belongs to a request - wait for one without taking its completion. */
+			if (!ns->queue->busy)
+				return BL_STATUS_INSUFFICIENT_RESOURCES;
+
+			if (!bl_poll_until(bl_nvme_cid_available(ns->queue), BL_NVME_COMMAND_TIMEOUT))
+				return BL_STATUS_DISK_OPERATION_TIMEOUT;
+
+			continue;
+		}
+
+		issued = 0;
+
+		status = bl_nvme_issue_read(ns, buf, lba, chunk, &issued);
+		if (status) {
+			bl_nvme_wait_commands(ns->queue, issued);
+			return status;
+		}
+
+		status = bl_nvme_wait_commands(ns->queue, issued);
+		if (status)
+			return status;
+
+		buf += chunk * BL_STORAGE_SECTOR_SIZE;
+		lba += chunk;
+		sectors -= chunk;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+/*
+ * Issue as much of the rest of the request as the free command IDs allow - tag holds
+ * their IDs. Requests larger than the queue are issued in parts, from poll.
+ */
+static bl_status_t bl_nvme_issue_request(struct bl_nvme_namespace *ns,
+	struct bl_storage_request *request)
+{
+	bl_status_t status;
+	bl_uint64_t sectors, max_sectors;
+
+	max_sectors = ns->controller->max_transfer / BL_STORAGE_SECTOR_SIZE;
+
+	request->tag = 0;
+
+	bl_nvme_queue_reap(ns->queue);
+
+	sectors = BL_MIN(request->sectors - request->issued,
+		bl_nvme_free_cids(ns->queue) * max_sectors);
+	if (!sectors)
+		return BL_STATUS_INSUFFICIENT_RESOURCES;
+
+	status = bl_nvme_issue_read(ns, request->buf + request->issued * BL_STORAGE_SECTOR_SIZE,
+		request->lba + request->issued, sectors, &request->tag);
+	if (status) {
+		bl_nvme_wait_commands(ns->queue, request->tag);
+		return status;
+	}
+
+	request->issued += sectors;
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_nvme_submit(struct bl_storage_device *disk,
+	struct bl_storage_request *request)
+{
+	request->tag = 0;
+	request->issued = 0;
+
+	if (!request->sectors)
+		return BL_STATUS_SUCCESS;
+
+	return bl_nvme_issue_request(disk->data, request);
+}
+
+static bl_status_t bl_nvme_poll(struct bl_storage_device *disk,
+	struct bl_storage_request *request)
+{
+	bl_status_t status;
+	struct bl_nvme_namespace *ns;
+
+	ns = disk->data;
+
+	status = bl_nvme_command_status(ns->queue, request->tag);
+	if (status || request->issued == request->sectors)
+		return status;
+
+	/* The previous part is done, issue the next one. */
+	status = bl_nvme_issue_request(ns, request);
+
+	/* IDs are taken by other requests - try again on the next poll. */
+	if (status && status != BL_STATUS_INSUFFICIENT_RESOURCES)
+		return status;
+
+	return BL_STATUS_DISK_OPERATION_NOT_FINISHED;
+}
+
+static bl_status_t bl_nvme_create_io_queue(struct bl_nvme_controller *nvme,
+	struct bl_nvme_queue *queue)
+{
+	bl_status_t status;
+	struct bl_nvme_sq_entry command;
+
+	/* Completion queue first, the submission queue refers to it. */
+	bl_memset(&command, 0, sizeof(struct bl_nvme_sq_entry));
+
+	command.opcode = BL_NVME_ADMIN_CREATE_CQ;
+	command.cdw10 = ((queue->size - 1) << 16) | queue->id;
+	command.cdw11 = BL_NVME_QUEUE_PHYS_CONTIG;
+
+	status = bl_nvme_admin_command(nvme, &command, (void *)queue->cq, NULL);
+	if (status)
+		return status;
+
+	bl_memset(&command, 0, sizeof(struct bl_nvme_sq_entry));
+
+	command.opcode = BL_NVME_ADMIN_CREATE_SQ;
+	command.cdw10 = ((queue->size - 1) << 16) | queue->id;
+	command.cdw11 = (queue->id << 16) | BL_NVME_QUEUE_PHYS_CONTIG;
+
+	return bl_nvme_admin_command(nvme, &command, (void *)queue->sq, NULL);
+}
+
+static bl_status_t bl_nvme_create_io_queues(struct bl_nvme_controller *nvme)
+{
+	int i, count;
+	bl_uint32_t result;
+	bl_status_t status;
+	struct bl_nvme_sq_entry command;
+
+	/* Ask for the queue pairs, the controller may grant fewer. */
+	bl_memset(&command, 0, sizeof(struct bl_nvme_sq_entry));
+
+	command.opcode = BL_NVME_ADMIN_SET_FEATURES;
+	command.cdw10 = BL_NVME_FEATURE_NUMBER_OF_QUEUES;
+	command.cdw11 = ((BL_NVME_IO_QUEUES - 1) << 16) | (BL_NVME_IO_QUEUES - 1);
+
+	status = bl_nvme_admin_command(nvme, &command, NULL, &result);
+	if (status)
+		return status;
+
+	count = BL_MIN(BL_NVME_IO_QUEUES, (int)BL_MIN(result & 0xffff, result >> 16) + 1);
+
+	nvme->io_queues = bl_heap_alloc(count * sizeof(struct bl_nvme_queue));
+	if (!nvme->io_queues)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	for (i = 0; i < count; i++) {
+		status = bl_nvme_queue_init(nvme, &nvme->io_queues[i], i + 1,
+			BL_MIN(BL_NVME_IO_QUEUE_SIZE, BL_NVME_CAP_MQES(nvme->regs->cap) + 1), 1);
+		if (status)
+			return status;
+
+		status = bl_nvme_create_io_queue(nvme, &nvme->io_queues[i]);
+		if (status)
+			break;
+	}
+
+	if (!i)
+		return status;
+
+	nvme->io_queue_count = i;
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_nvme_detect_namespaces(struct bl_nvme_controller *nvme)
+{
+	int i;
+	bl_status_t status;
+	bl_uint32_t *nsids;
+	struct bl_nvme_identify_namespace *id;
+	struct bl_nvme_namespace *ns;
+
+	nsids = bl_heap_alloc_align(BL_NVME_PAGE_SIZE, BL_NVME_PAGE_SIZE);
+	if (!nsids)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	id = bl_heap_alloc_align(BL_NVME_PAGE_SIZE, BL_NVME_PAGE_SIZE);
+	if (!id) {
+		status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
+		goto _exit;
+	}
+
+	status = bl_nvme_identify(nvme, BL_NVME_IDENTIFY_ACTIVE_NAMESPACES, 0, nsids);
+	if (status)
+		goto _exit;
+
+	for (i = 0; i < BL_NVME_PAGE_SIZE / sizeof(bl_uint32_t) && nsids[i]; i++) {
+		if (bl_nvme_identify(nvme, BL_NVME_IDENTIFY_NAMESPACE, nsids[i], id))
+			continue;
+
+		/* The block layer works in 512 byte sectors. */
+		if (id->lbaf[BL_NVME_FLBAS_FORMAT(id->flbas)].lbads != 9)
+			continue;
+
+		ns = bl_heap_alloc(sizeof(struct bl_nvme_namespace));
+		if (!ns) {
+			status = BL_STATUS_MEMORY_ALLOCATION_FAILED;
+			goto _exit;
+		}
+
+		ns->nsid = nsids[i];
+		ns->sectors = id->nsze;
+		ns->controller = nvme;
+
+		/* Spread namespaces over the queue pairs. */
+		ns->queue = &nvme->io_queues[i % nvme->io_queue_count];
+
+		bl_nvme_namespace_add(ns);
+	}
+
+_exit:
+	if (id)
+		bl_heap_free(id, BL_NVME_PAGE_SIZE);
+
+	bl_heap_free(nsids, BL_NVME_PAGE_SIZE);
+
+	return status;
+}
+
+static bl_status_t bl_nvme_controller_init(struct bl_nvme_controller *nvme)
+{
+	bl_status_t status;
+	bl_uint32_t timeout;
+	struct bl_nvme_identify_controller *id;
+
+	/* Only the 4KB memory page & NVM command set are used. */
+	if (BL_NVME_CAPU_MPSMIN(nvme->regs->capu) || !BL_NVME_CAPU_CSS_NVM(nvme->regs->capu))
+		return BL_STATUS_UNSUPPORTED;
+
+	nvme->doorbell_stride = 4 << BL_NVME_CAPU_DSTRD(nvme->regs->capu);
+
+	/* CAP.TO is in 500ms units. */
+	timeout = BL_NVME_CAP_TO(nvme->regs->cap) * 500000;
+
+	/* Reset. */
+	nvme->regs->cc &= ~BL_NVME_CC_EN;
+	if (!bl_poll_until((nvme->regs->csts & BL_NVME_CSTS_RDY) == 0, timeout))
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+
+	/* Admin queues. */
+	status = bl_nvme_queue_init(nvme, &nvme->admin, 0, BL_NVME_ADMIN_QUEUE_SIZE, 0);
+	if (status)
+		return status;
+
+	nvme->regs->aqa = BL_NVME_AQA(BL_NVME_ADMIN_QUEUE_SIZE, BL_NVME_ADMIN_QUEUE_SIZE);
+	nvme->regs->asq = (bl_addr_t)nvme->admin.sq;
+	nvme->regs->asqu = 0;
+	nvme->regs->acq = (bl_addr_t)nvme->admin.cq;
+	nvme->regs->acqu = 0;
+
+	/* Enable. */
+	nvme->regs->cc = BL_NVME_CC_EN | BL_NVME_CC_CSS_NVM | BL_NVME_CC_MPS_4K |
+		BL_NVME_CC_AMS_RR | BL_NVME_CC_IOSQES | BL_NVME_CC_IOCQES;
+
+	if (!bl_poll_until(nvme->regs->csts & (BL_NVME_CSTS_RDY | BL_NVME_CSTS_CFS), timeout) ||
+			(nvme->regs->csts & BL_NVME_CSTS_CFS))
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+
+	id = bl_heap_alloc_align(BL_NVME_PAGE_SIZE, BL_NVME_PAGE_SIZE);
+	if (!id)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	status = bl_nvme_identify(nvme, BL_NVME_IDENTIFY_CONTROLLER, 0, id);
+	if (status) {
+		bl_heap_free(id, BL_NVME_PAGE_SIZE);
+		return status;
+	}
+
+	/* MDTS is a power of two in pages, 0 is no limit. */
+	nvme->max_transfer = BL_NVME_MAX_TRANSFER;
+	if (id->mdts && id->mdts < 20)
+		nvme->max_transfer = BL_MIN(nvme->max_transfer,
+			(bl_size_t)BL_NVME_PAGE_SIZE << id->mdts);
+
+	bl_heap_free(id, BL_NVME_PAGE_SIZE);
+
+	status = bl_nvme_create_io_queues(nvme);
+	if (status)
+		return status;
+
+	return bl_nvme_detect_namespaces(nvme);
+}
+
+static bl_status_t bl_nvme_pci_initialize(struct bl_pci_index i)
+{
+	bl_status_t status;
+	bl_uint32_t base_address;
+	struct bl_nvme_controller *nvme;
+
+	/* Check PCI device. */
+	status = bl_pci_check_device_class(i, BL_PCI_BASE_CLASS_STORAGE,
+			BL_PCI_SUBCLASS_STORAGE_NVM, BL_PCI_PROG_IF_STORAGE_NVM_NVME);
+	if (status)
+		return status;
+
+	/* Registers must be reachable without paging. */
+	base_address = bl_pci_read_config_long(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_BAR0);
+	if ((base_address & BL_NVME_PCI_BAR0_TYPE_64) &&
+			bl_pci_read_config_long(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_BAR1))
+		return BL_STATUS_UNSUPPORTED;
+
+	bl_pci_write_config_word(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_COMMAND,
+		bl_pci_read_config_word(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_COMMAND) |
+			BL_PCI_COMMAND_MEMORY_SPACE | BL_PCI_COMMAND_BUS_MASTER);
+
+	nvme = bl_heap_alloc(sizeof(struct bl_nvme_controller));
+	if (!nvme)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	nvme->regs = (void *)(base_address & BL_NVME_PCI_BAR0_BA);
+	nvme->io_queue_count = 0;
+	nvme->io_queues = NULL;
+
+	return bl_nvme_controller_init(nvme);
+}
+
+static struct bl_disk_controller_functions nvme_functions = {
+	.type = BL_DISK_CONTROLLER_TYPE_NVME,
+	.read = bl_nvme_read,
+	.readv = NULL,
+	.submit = bl_nvme_submit,
+	.poll = bl_nvme_poll,
+	.get_info = NULL,
+};
+
+BL_MODULE_INIT()
+{
+	struct bl_nvme_namespace *ns;
+	struct bl_disk_controller *controller;
+
+	bl_pci_iterate_devices(bl_nvme_pci_initialize);
+
+	controller = bl_heap_alloc(sizeof(struct bl_disk_controller));
+	if (!controller)
+		return;
+
+	controller->funcs = &nvme_functions;
+	controller->data = NULL;
+	controller->probe_us = 0;
+	controller->next = NULL;
+
+	bl_disk_controller_register(controller);
+
+	ns = bl_nvme_namespace_list;
+	while (ns) {
+		struct bl_storage_device *disk;
+
+		disk = bl_heap_alloc(sizeof(struct bl_storage_device));
+		if (!disk)
+			return;
+
+		disk->type = BL_STORAGE_TYPE_HARD_DRIVE;
+		disk->controller = controller;
+		disk->sector_size = BL_STORAGE_SECTOR_SIZE;
+		disk->sector_count = ns->sectors;
+		disk->data = ns;
+		disk->next = NULL;
+
+		bl_storage_device_register(disk);
+
+		/* Let the block layer keep the queue busy. */
+		bl_storage_device_set_queue_depth(disk, ns->queue->size - 1);
+
+		ns = ns->next;
+	}
+}
+
+BL_MODULE_UNINIT()
+{
+
+}
@@ -0,0 +1,168 @@
+#ifndef BL_NVME_H
+#define BL_NVME_H
+
+#include "include/bl-types.h"
+
+/* NVM Express definitions. */
+
+/* PCI BAR0, 64-bit memory BAR. */
+enum {
+	BL_NVME_PCI_BAR0_TYPE_64	= (2 << 1),
+	BL_NVME_PCI_BAR0_BA		= (0xfffffff0),
+};
+
+/* Controller registers. 64-bit registers are split, host accesses them 32 bits at a time. */
+struct bl_nvme_registers {
+	__u32	cap;
+	__u32	capu;
+	__u32	vs;
+	__u32	intms;
+	__u32	intmc;
+	__u32	cc;
+	__u32	reserved0;
+	__u32	csts;
+	__u32	nssr;
+	__u32	aqa;
+	__u32	asq;
+	__u32	asqu;
+	__u32	acq;
+	__u32	acqu;
+};
+
+/* CAP. */
+#define BL_NVME_CAP_MQES(cap)		((cap) & 0xffff)
+#define BL_NVME_CAP_TO(cap)		(((cap) >> 24) & 0xff)
+#define BL_NVME_CAPU_DSTRD(capu)	((capu) & 0xf)
+#define BL_NVME_CAPU_CSS_NVM(capu)	(((capu) >> 5) & 0x1)
+#define BL_NVME_CAPU_MPSMIN(capu)	(((capu) >> 16) & 0xf)
+
+/* CC. */
+enum {
+	BL_NVME_CC_EN		= (1 << 0),
+	BL_NVME_CC_CSS_NVM	= (0 << 4),
+	BL_NVME_CC_MPS_4K	= (0 << 7),
+	BL_NVME_CC_AMS_RR	= (0 << 11),
+	BL_NVME_CC_IOSQES	= (6 << 16),
+	BL_NVME_CC_IOCQES	= (4 << 20),
+};
+
+/* CSTS. */
+enum {
+	BL_NVME_CSTS_RDY	= (1 << 0),
+	BL_NVME_CSTS_CFS	= (1 << 1),
+};
+
+#define BL_NVME_AQA(sq_size, cq_size)	((((cq_size) - 1) << 16) | ((sq_size) - 1))
+
+/* Doorbells follow the registers, 4 << DSTRD bytes apart. */
+#define BL_NVME_DOORBELL_BASE	0x1000
+
+/* Submission queue entry. */
+struct bl_nvme_sq_entry {
+	__u8	opcode;
+	__u8	flags;
+	__u16	cid;
+	__u32	nsid;
+	__u32	cdw2;
+	__u32	cdw3;
+	__u64	mptr;
+	__u64	prp1;
+	__u64	prp2;
+	__u32	cdw10;
+	__u32	cdw11;
+	__u32	cdw12;
+	__u32	cdw13;
+	__u32	cdw14;
+	__u32	cdw15;
+} __attribute__((packed));
+
+/* Completion queue entry. */
+struct bl_nvme_cq_entry {
+	__u32	dw0;
+	__u32	dw1;
+	__u16	sq_head;
+	__u16	sq_id;
+	__u16	cid;
+	__u16	status;
+} __attribute__((packed));
+
+#define BL_NVME_CQ_STATUS_PHASE		(1 << 0)
+#define BL_NVME_CQ_STATUS_CODE(status)	((status) >> 1)
+
+/* Admin commands. */
+enum {
+	BL_NVME_ADMIN_CREATE_SQ		= 0x01,
+	BL_NVME_ADMIN_CREATE_CQ		= 0x05,
+	BL_NVME_ADMIN_IDENTIFY		= 0x06,
+	BL_NVME_ADMIN_SET_FEATURES	= 0x09,
+};
+
+/* Create I/O queue flags. */
+#define BL_NVME_QUEUE_PHYS_CONTIG	(1 << 0)
+
+/* Identify CNS values. */
+enum {
+	BL_NVME_IDENTIFY_NAMESPACE		= 0x00,
+	BL_NVME_IDENTIFY_CONTROLLER		= 0x01,
+	BL_NVME_IDENTIFY_ACTIVE_NAMESPACES	= 0x02,
+};
+
+/* Set Features IDs. */
+#define BL_NVME_FEATURE_NUMBER_OF_QUEUES	0x07
+
+/* NVM commands. */
+enum {
+	BL_NVME_NVM_READ	= 0x02,
+};
+
+struct bl_nvme_identify_controller {
+	__u16	vid;
+	__u16	ssvid;
+	__u8	sn[20];
+	__u8	mn[40];
+	__u8	fr[8];
+	__u8	rab;
+	__u8	ieee[3];
+	__u8	cmic;
+	__u8	mdts;
+	__u8	unused0[516 - 78];
+	__u32	nn;
+	__u8	unused1[4096 - 520];
+} __attribute__((packed));
+
+struct bl_nvme_lba_format {
+	__u16	ms;
+	__u8	lbads;
+	__u8	rp;
+} __attribute__((packed));
+
+struct bl_nvme_identify_namespace {
+	__u64	nsze;
+	__u64	ncap;
+	__u64	nuse;
+	__u8	nsfeat;
+	__u8	nlbaf;
+	__u8	flbas;
+	__u8	unused0[128 - 27];
+	struct bl_nvme_lba_format lbaf[16];
+	__u8	unused1[4096 - 192];
+} __attribute__((packed));
+
+#define BL_NVME_FLBAS_FORMAT(flbas)	((flbas) & 0xf)
+
+/* Memory page size (CC.MPS), everything queue related is allocated in pages. */
+#define BL_NVME_PAGE_SIZE	0x1000
+
+/* One PRP list page per command, chaining isn't needed within this. */
+#define BL_NVME_PRP_ENTRIES	(BL_NVME_PAGE_SIZE / sizeof(bl_uint64_t))
+#define BL_NVME_MAX_TRANSFER	(BL_NVME_PRP_ENTRIES * BL_NVME_PAGE_SIZE)
+
+/* Queue sizes & I/O queue pairs to create. Command IDs are tracked in 32-bit masks. */
+#define BL_NVME_ADMIN_QUEUE_SIZE	8
+#define BL_NVME_IO_QUEUE_SIZE		32
+#define BL_NVME_IO_QUEUES		2
+
+/* Microseconds to wait for issued commands. */
+#define BL_NVME_COMMAND_TIMEOUT	1000000
+
+#endif
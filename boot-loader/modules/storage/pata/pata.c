@@ -1,5 +1,6 @@
 #include "pata.h"
 #include "include/time.h"
+#include "include/bl-utils.h"
 #include "core/include/loader/loader.h"
 #include "core/include/storage/storage.h"
 #include "core/include/pci/pci.h"
@@ -10,10 +11,19 @@ BL_MODULE_NAME("Parallel ATA");
 /* Device by channel. */
 struct bl_pata_device {
 	bl_port_t io;
+	bl_port_t control;
 
 	int type;
 	int present;
 
+	/* Sectors per PIO data block. */
+	int multiple;
+
+	/* Bus master IDE - zero if the channel has none. */
+	bl_port_t bm;
+	int dma;
+	volatile struct bl_pata_prd *prdt;
+
 	struct bl_pata_identification id;
 
 	struct bl_pata_device *next;
@@ -36,41 +46,54 @@ static inline bl_uint8_t bl_pata_read_reg(struct bl_pata_device *device, int reg
 	return bl_inb(device->io + reg);
 }
 
-static inline bl_uint16_t bl_pata_read_data(struct bl_pata_device *device)
+/* Alternate status doesn't acknowledge a pending interrupt. */
+static inline bl_uint8_t bl_pata_read_alt_status(struct bl_pata_device *device)
 {
-	return bl_inw(device->io + BL_PATA_REG__READ__DPATA);
+	return bl_inb(device->control);
 }
 
-static bl_status_t bl_pata_wait_ready(struct bl_pata_device *device)
+/* Status is valid 400ns after a command is written - 4 alternate status reads. */
+static inline void bl_pata_delay(struct bl_pata_device *device)
 {
-	int timeout = 100;
+	int i;
 
-	while (--timeout) {
-		if ((bl_pata_read_reg(device, BL_PATA_REG__READ__STATUS) &
-					BL_PATA_REG_STATUS_BSY) == 0)
-			return BL_STATUS_SUCCESS;
+	for (i = 0; i < 4; i++)
+		bl_pata_read_alt_status(device);
+}
 
-		bl_time_sleep(1);
-	}
+static bl_status_t bl_pata_wait_ready(struct bl_pata_device *device)
+{
+	if (bl_poll_until((bl_pata_read_reg(device, BL_PATA_REG__READ__STATUS) &
+				BL_PATA_REG_STATUS_BSY) == 0, 100000))
+		return BL_STATUS_SUCCESS;
 
 	return BL_STATUS_DISK_OPERATION_TIMEOUT;
 }
 
-static void bl_pata_buffer_read_sector(struct bl_pata_device *device, bl_uint16_t *buf)
+static bl_status_t bl_pata_wait_drq(struct bl_pata_device *device)
 {
-	int i;
+	bl_uint8_t status;
+
+	if (!bl_poll_until((status = bl_pata_read_alt_status(device),
+				(status & BL_PATA_REG_STATUS_BSY) == 0 &&
+				status & (BL_PATA_REG_STATUS_DRQ | BL_PATA_REG_STATUS_ERR)), 100000))
+		return BL_STATUS_DISK_OPERATION_TIMEOUT;
 
-	for (i = 0; i < BL_STORAGE_SECTOR_SIZE / 2; i++)
-		buf[i] = bl_pata_read_data(device);
+	if (status & BL_PATA_REG_STATUS_ERR)
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+
+	return BL_STATUS_SUCCESS;
 }
 
-static bl_status_t bl_pata_device_command(struct bl_pata_device *device, bl_uint8_t command,
-		bl_uint8_t *buf, bl_uint64_t buf_sectors, bl_uint64_t lba, bl_uint64_t sectors)
+static void bl_pata_buffer_read_sectors(struct bl_pata_device *device, bl_uint8_t *buf,
+		bl_uint64_t sectors)
 {
-	bl_uint64_t i;
-	bl_status_t status;
-	bl_uint8_t read_status;
+	bl_insw(device->io + BL_PATA_REG__READ__DPATA, buf, sectors * BL_STORAGE_SECTOR_SIZE / 2);
+}
 
+static void bl_pata_issue_command(struct bl_pata_device *device, bl_uint8_t command,
+		bl_uint64_t lba, bl_uint64_t sectors)
+{
 	/* Either way, use the 48-bit address feature set */
 	/* "Previous content" */
 	bl_pata_write_reg(device, BL_PATA_REG__WRITE__FEATURES, 0);
@@ -93,47 +116,190 @@ static bl_status_t bl_pata_device_command(struct bl_pata_device *device, bl_uint
 
 	/* Start command */
 	bl_pata_write_reg(device, BL_PATA_REG__WRITE__COMMAND, command);
+}
+
+/* PIO data in command, transferring `block` sectors per DRQ. */
+static bl_status_t bl_pata_device_command(struct bl_pata_device *device, bl_uint8_t command,
+		bl_uint8_t *buf, bl_uint64_t lba, bl_uint64_t sectors, int block)
+{
+	bl_uint64_t count;
+	bl_status_t status;
+
+	bl_pata_issue_command(device, command, lba, sectors);
+	bl_pata_delay(device);
+
+	while (sectors) {
+		status = bl_pata_wait_drq(device);
+		if (status)
+			return status;
+
+		count = BL_MIN(sectors, block);
+		bl_pata_buffer_read_sectors(device, buf, count);
+
+		buf += count * BL_STORAGE_SECTOR_SIZE;
+		sectors -= count;
+	}
+
+	/* Acknowledge & check final status. */
 	status = bl_pata_wait_ready(device);
 	if (status)
 		return status;
 
-	/* Check status */
-	read_status = bl_pata_read_reg(device, BL_PATA_REG__READ__STATUS);
+	if (bl_pata_read_reg(device, BL_PATA_REG__READ__STATUS) & BL_PATA_REG_STATUS_ERR)
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
 
-	for (i = 0; i < buf_sectors; i++) {
-		if ((read_status & (BL_PATA_REG_STATUS_DRQ | BL_PATA_REG_STATUS_ERR)) ==
-				BL_PATA_REG_STATUS_ERR)
-			break;
+	return BL_STATUS_SUCCESS;
+}
 
-		bl_pata_buffer_read_sector(device, (bl_uint16_t *)(buf + i *
-					BL_STORAGE_SECTOR_SIZE));
+static bl_status_t bl_pata_pio_read(struct bl_pata_device *device, bl_uint8_t *buf,
+		bl_uint64_t lba, bl_uint64_t sectors)
+{
+	int command;
+	bl_uint64_t count, max;
+	bl_status_t status;
 
-		status = bl_pata_wait_ready(device);
+	if (device->id.sectors_lba48) {
+		command = device->multiple > 1 ? BL_PATA_CMD_READ_MULTIPLE_EXT :
+			BL_PATA_CMD_READ_SECTORS_EXT;
+		max = BL_PATA_LBA48_MAX_SECTORS;
+	} else {
+		command = device->multiple > 1 ? BL_PATA_CMD_READ_MULTIPLE :
+			BL_PATA_CMD_READ_SECTORS;
+		max = BL_PATA_LBA28_MAX_SECTORS;
+	}
+
+	while (sectors) {
+		count = BL_MIN(sectors, max);
+
+		/* A full chunk goes out as a zero sector count, which the drive reads as max. */
+		status = bl_pata_device_command(device, command, buf, lba, count,
+				device->multiple);
 		if (status)
 			return status;
 
-		read_status = bl_pata_read_reg(device, BL_PATA_REG__READ__STATUS);
+		buf += count * BL_STORAGE_SECTOR_SIZE;
+		lba += count;
+		sectors -= count;
 	}
 
 	return BL_STATUS_SUCCESS;
 }
 
-static bl_status_t bl_pata_read(struct bl_storage_device *disk, bl_uint8_t *buf,
+static inline void bl_pata_bm_write(struct bl_pata_device *device, int reg, bl_uint8_t val)
+{
+	bl_outb(val, device->bm + reg);
+}
+
+static inline bl_uint8_t bl_pata_bm_read(struct bl_pata_device *device, int reg)
+{
+	return bl_inb(device->bm + reg);
+}
+
+/* Describe the buffer with regions that don't cross 64KB boundaries. */
+static bl_status_t bl_pata_dma_build_prdt(struct bl_pata_device *device, bl_uint8_t *buf,
+		bl_size_t size)
+{
+	int i;
+	bl_addr_t addr;
+	bl_size_t count;
+
+	for (i = 0, addr = (bl_addr_t)buf; size; i++) {
+		if (i == BL_PATA_PRD_ENTRIES)
+			return BL_STATUS_INVALID_PARAMETERS;
+
+		count = BL_MIN(size, BL_PATA_PRD_BOUNDARY - (addr & (BL_PATA_PRD_BOUNDARY - 1)));
+
+		device->prdt[i].address = addr;
+		device->prdt[i].byte_count = count & 0xffff;
+		device->prdt[i].flags = 0;
+
+		addr += count;
+		size -= count;
+	}
+
+	device->prdt[i - 1].flags = BL_PATA_PRD_EOT;
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_pata_dma_read(struct bl_pata_device *device, bl_uint8_t *buf,
 		bl_uint64_t lba, bl_uint64_t sectors)
 {
 	bl_status_t status;
-	struct bl_pata_device *device;
+	bl_uint8_t bm_status, read_status;
 
-	device = disk->data;
+	status = bl_pata_dma_build_prdt(device, buf, sectors * BL_STORAGE_SECTOR_SIZE);
+	if (status)
+		return status;
+
+	/* Stop the engine, point it to the PRDT & clear old status. */
+	bl_pata_bm_write(device, BL_PATA_BM_REG_COMMAND, 0);
+	bl_outl((bl_addr_t)device->prdt, device->bm + BL_PATA_BM_REG_PRDT);
+	bl_pata_bm_write(device, BL_PATA_BM_REG_STATUS, BL_PATA_BM_STATUS_ERROR |
+			BL_PATA_BM_STATUS_IRQ);
+
+	bl_pata_bm_write(device, BL_PATA_BM_REG_COMMAND, BL_PATA_BM_COMMAND_READ);
+
+	bl_pata_issue_command(device, BL_PATA_CMD_READ_SECTORS_DMA_EXT, lba,
+			sectors & (BL_PATA_DMA_MAX_SECTORS - 1));
+
+	bl_pata_bm_write(device, BL_PATA_BM_REG_COMMAND, BL_PATA_BM_COMMAND_READ |
+			BL_PATA_BM_COMMAND_START);
+
+	/* Transfer is done once the device raises its interrupt. */
+	if (!bl_poll_until((bm_status = bl_pata_bm_read(device, BL_PATA_BM_REG_STATUS),
+				bm_status & (BL_PATA_BM_STATUS_IRQ | BL_PATA_BM_STATUS_ERROR)),
+				BL_PATA_DMA_TIMEOUT))
+		status = BL_STATUS_DISK_OPERATION_TIMEOUT;
+
+	bl_pata_bm_write(device, BL_PATA_BM_REG_COMMAND, 0);
+	bl_pata_bm_write(device, BL_PATA_BM_REG_STATUS, BL_PATA_BM_STATUS_ERROR |
+			BL_PATA_BM_STATUS_IRQ);
 
-	status = bl_pata_device_command(device, BL_PATA_CMD_READ_SECTORS, buf, sectors,
-			lba, sectors);
 	if (status)
 		return status;
 
+	status = bl_pata_wait_ready(device);
+	if (status)
+		return status;
+
+	read_status = bl_pata_read_reg(device, BL_PATA_REG__READ__STATUS);
+	if ((bm_status & BL_PATA_BM_STATUS_ERROR) || (read_status & BL_PATA_REG_STATUS_ERR))
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+
 	return BL_STATUS_SUCCESS;
 }
 
+static bl_status_t bl_pata_read(struct bl_storage_device *disk, bl_uint8_t *buf,
+		bl_uint64_t lba, bl_uint64_t sectors)
+{
+	bl_uint64_t count;
+	bl_status_t status;
+	struct bl_pata_device *device;
+
+	device = disk->data;
+
+	while (device->dma && sectors) {
+		count = BL_MIN(sectors, BL_PATA_DMA_MAX_SECTORS);
+
+		status = bl_pata_dma_read(device, buf, lba, count);
+		if (status) {
+			/* Don't trust DMA anymore - continue with PIO. */
+			device->dma = 0;
+			break;
+		}
+
+		buf += count * BL_STORAGE_SECTOR_SIZE;
+		lba += count;
+		sectors -= count;
+	}
+
+	if (!sectors)
+		return BL_STATUS_SUCCESS;
+
+	return bl_pata_pio_read(device, buf, lba, sectors);
+}
+
 static bl_status_t bl_pata_device_connected(struct bl_pata_device *device)
 {
 	bl_uint8_t status;
@@ -141,29 +307,25 @@ static bl_status_t bl_pata_device_connected(struct bl_pata_device *device)
 	/* Select device. */
 	bl_pata_write_reg(device, BL_PATA_REG__WRITE__DEVICE,
 			BL_PATA_REG_DEVICE_SET(1, device->type));
-	bl_time_sleep(1);
+	bl_time_udelay(1);
+
+	/* Nothing drives a floating bus - no need to wait for a timeout. */
+	if (bl_pata_read_reg(device, BL_PATA_REG__READ__STATUS) == 0xff)
+		return BL_STATUS_FAILURE;
 
 	/* Execute command. */
 	bl_pata_write_reg(device, BL_PATA_REG__WRITE__COMMAND,
 			BL_PATA_CMD_IDENTIFY_DEVICE);
-	bl_time_sleep(1);
+	bl_time_udelay(1);
 
 	/* Check for connection. */
 	status = bl_pata_read_reg(device, BL_PATA_REG__READ__STATUS);
 	if (status == 0)
 		return BL_STATUS_FAILURE;
 
-	int timeout = 50;
-	while (--timeout) {
-		status = bl_pata_read_reg(device, BL_PATA_REG__READ__STATUS);
-		if ((status & BL_PATA_REG_STATUS_BSY) == 0 &&
-				status & BL_PATA_REG_STATUS_DRQ)
-			break;
-
-		bl_time_sleep(1);
-	}
-
-	if (!timeout)
+	if (!bl_poll_until((status = bl_pata_read_reg(device, BL_PATA_REG__READ__STATUS),
+				(status & BL_PATA_REG_STATUS_BSY) == 0 &&
+				status & BL_PATA_REG_STATUS_DRQ), 50000))
 		return BL_STATUS_FAILURE;
 
 	return BL_STATUS_SUCCESS;
@@ -172,10 +334,53 @@ static bl_status_t bl_pata_device_connected(struct bl_pata_device *device)
 static bl_status_t bl_pata_identify_device(struct bl_pata_device *device,
 		bl_uint8_t *buf)
 {
-	return bl_pata_device_command(device, BL_PATA_CMD_IDENTIFY_DEVICE, buf, 1, 0, 0);
+	return bl_pata_device_command(device, BL_PATA_CMD_IDENTIFY_DEVICE, buf, 0, 1, 1);
+}
+
+/* Move as many sectors as the device allows per DRQ block. */
+static void bl_pata_set_multiple_mode(struct bl_pata_device *device)
+{
+	int block;
+
+	device->multiple = 1;
+
+	block = BL_PATA_ID_MULTIPLE(device->id.max_multiple);
+	if (block <= 1)
+		return;
+
+	bl_pata_issue_command(device, BL_PATA_CMD_SET_MULTIPLE_MODE, 0, block);
+	bl_pata_delay(device);
+
+	if (bl_pata_wait_ready(device))
+		return;
+
+	if (bl_pata_read_reg(device, BL_PATA_REG__READ__STATUS) & BL_PATA_REG_STATUS_ERR)
+		return;
+
+	device->multiple = block;
+}
+
+static void bl_pata_setup_dma(struct bl_pata_device *device, bl_port_t bm)
+{
+	device->bm = bm;
+	device->dma = 0;
+	device->prdt = NULL;
+
+	if (!bm || !(device->id.capabilities & BL_PATA_ID_CAP_DMA) ||
+			!device->id.sectors_lba48)
+		return;
+
+	/* Table size alignment keeps it within one 64KB region. */
+	device->prdt = bl_heap_alloc_align(BL_PATA_PRD_ENTRIES * sizeof(struct bl_pata_prd),
+			BL_PATA_PRD_ENTRIES * sizeof(struct bl_pata_prd));
+	if (!device->prdt)
+		return;
+
+	device->dma = 1;
 }
 
-static bl_status_t bl_pata_check_channel_device(int type, bl_port_t io)
+static bl_status_t bl_pata_check_channel_device(int type, bl_port_t io, bl_port_t control,
+		bl_port_t bm)
 {
 	bl_status_t status;
 	struct bl_pata_device *device;
@@ -188,6 +393,8 @@ static bl_status_t bl_pata_check_channel_device(int type, bl_port_t io)
 
 	device->type = type;
 	device->io = io;
+	device->control = control;
+	device->multiple = 1;
 
 	status = bl_pata_device_connected(device);
 	if (status)
@@ -199,6 +406,10 @@ static bl_status_t bl_pata_check_channel_device(int type, bl_port_t io)
 	if (status)
 		goto _exit;
 
+	bl_pata_set_multiple_mode(device);
+
+	bl_pata_setup_dma(device, bm);
+
 	bl_pata_device_add(device);
 
 	return BL_STATUS_SUCCESS;
@@ -224,11 +435,26 @@ static int bl_pata_get_port(int channel)
 	}
 }
 
+static int bl_pata_get_control_port(int channel)
+{
+	switch (channel) {
+		case 0:
+			return BL_PATA_PRIMARY_CONTROL_PORT;
+
+		case 1:
+			return BL_PATA_SECONDARY_CONTROL_PORT;
+
+		default:
+			return -1;
+	}
+}
+
 static bl_status_t bl_pata_pci_initialize(struct bl_pci_index i)
 {
 	int type, channel;
 	bl_status_t status;
-	bl_uint32_t bar, control_bar;
+	bl_uint32_t bar, control_bar, bm_bar;
+	bl_port_t bm;
 
 	/* Check PCI device. */
 	status = bl_pci_check_device_class(i, BL_PCI_BASE_CLASS_STORAGE,
@@ -236,6 +462,22 @@ static bl_status_t bl_pata_pci_initialize(struct bl_pci_index i)
 	if (status)
 		return status;
 
+	/* Bus master IDE registers are in I/O space pointed by BAR4. */
+	bm_bar = 0;
+	if (bl_pci_read_config_byte(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_PROG_IF) &
+			BL_PATA_PCI_PROG_IF_BUS_MASTER) {
+		bm_bar = bl_pci_read_config_long(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_BAR4);
+		if (bm_bar & BL_PATA_PCI_BAR4_RTE) {
+			bm_bar &= BL_PATA_PCI_BAR4_BASE_ADDRESS;
+
+			bl_pci_write_config_word(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_COMMAND,
+				bl_pci_read_config_word(i.bus, i.dev, i.func,
+					BL_PCI_CONFIG_REG_COMMAND) | BL_PCI_COMMAND_IO_SPACE |
+					BL_PCI_COMMAND_BUS_MASTER);
+		} else
+			bm_bar = 0;
+	}
+
 	/* Check channels. */
 	for (channel = 0; channel < 2; channel++) {
 		int offset = channel * 2 * sizeof(bl_uint32_t);
@@ -251,10 +493,15 @@ static bl_status_t bl_pata_pci_initialize(struct bl_pci_index i)
 
 		int port = bl_pata_get_port(channel);
 
+		bm = bm_bar ? bm_bar + channel * BL_PATA_BM_CHANNEL_SIZE : 0;
+
 		/* Support only master devices. */
 		for (type = 0; type < 1; type++) {
-			status = bl_pata_check_channel_device(type, port);
-			if (status)
+			status = bl_pata_check_channel_device(type, port,
+					bl_pata_get_control_port(channel), bm);
+
+			/* Absent device shouldn't hide the other channel. */
+			if (status == BL_STATUS_MEMORY_ALLOCATION_FAILED)
 				return status;
 		}
 	}
@@ -265,14 +512,19 @@ static bl_status_t bl_pata_pci_initialize(struct bl_pci_index i)
 static struct bl_disk_controller_functions pata_functions = {
 	.type = BL_DISK_CONTROLLER_TYPE_PATA,
 	.read = bl_pata_read,
+	.readv = NULL,
+	.submit = NULL,
+	.poll = NULL,
 	.get_info = NULL,
 };
 
 BL_MODULE_INIT()
 {
+	bl_uint64_t stamp;
 	struct bl_pata_device *device;
 	struct bl_disk_controller *controller;
 
+	stamp = bl_time_stamp();
 	bl_pci_iterate_devices(bl_pata_pci_initialize);
 
 	controller = bl_heap_alloc(sizeof(struct bl_disk_controller));
@@ -281,6 +533,7 @@ BL_MODULE_INIT()
 
 	controller->funcs = &pata_functions;
 	controller->data = NULL;
+	controller->probe_us = bl_time_elapsed_us(stamp);
 	controller->next = NULL;
 
 	bl_disk_controller_register(controller);
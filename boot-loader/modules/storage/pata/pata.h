@@ -6,9 +6,56 @@
 /* PATA PCI BAR4 register info. */
 enum {
 	BL_PATA_PCI_BAR4_RTE		= 0x01,
-	BL_PATA_PCI_BAR4_BASE_ADDRESS	= 0xffe0,
+	BL_PATA_PCI_BAR4_BASE_ADDRESS	= 0xfff0,
 };
 
+/* Programming interface - controller supports bus mastering. */
+#define BL_PATA_PCI_PROG_IF_BUS_MASTER	(1 << 7)
+
+/* Bus master IDE registers, relative to the channel base (BAR4 + 8 * channel). */
+enum {
+	BL_PATA_BM_REG_COMMAND	= 0x0,
+	BL_PATA_BM_REG_STATUS	= 0x2,
+	BL_PATA_BM_REG_PRDT	= 0x4,
+};
+
+#define BL_PATA_BM_CHANNEL_SIZE	0x8
+
+/* Bus master command register. */
+enum {
+	BL_PATA_BM_COMMAND_START	= (1 << 0),
+	BL_PATA_BM_COMMAND_READ		= (1 << 3), /* Device to memory. */
+};
+
+/* Bus master status register. */
+enum {
+	BL_PATA_BM_STATUS_ACTIVE	= (1 << 0),
+	BL_PATA_BM_STATUS_ERROR		= (1 << 1),
+	BL_PATA_BM_STATUS_IRQ		= (1 << 2),
+};
+
+/*
+ * Physical Region Descriptor. A region can't cross a 64KB boundary, and
+ * byte count of 0 means 64KB.
+ */
+struct bl_pata_prd {
+	__u32	address;
+	__u16	byte_count;
+	__u16	flags;
+} __attribute__((packed));
+
+#define BL_PATA_PRD_EOT			(1 << 15)
+#define BL_PATA_PRD_BOUNDARY		0x10000
+
+/* Enough for the largest transfer when split on 64KB boundaries. */
+#define BL_PATA_PRD_ENTRIES		1024
+
+/* READ DMA EXT sector count of 0 means 65536. */
+#define BL_PATA_DMA_MAX_SECTORS		0x10000
+
+/* Microseconds to wait for a DMA transfer. */
+#define BL_PATA_DMA_TIMEOUT		1000000
+
 /* Channels and ports. */
 enum {
 	BL_PATA_PRIMARY_PORT		= 0x1f0,
@@ -87,6 +134,9 @@ enum {
 /* PATA commands */
 enum {
 	BL_PATA_CMD_IDENTIFY_DEVICE		= 0xec,
+	BL_PATA_CMD_SET_MULTIPLE_MODE		= 0xc6,
+	BL_PATA_CMD_READ_MULTIPLE		= 0xc4,
+	BL_PATA_CMD_READ_MULTIPLE_EXT		= 0x29,
 	BL_PATA_CMD_READ_SECTORS		= 0x20,
 	BL_PATA_CMD_READ_SECTORS_EXT		= 0x24,
 	BL_PATA_CMD_READ_SECTORS_DMA_EXT	= 0x25,
@@ -105,14 +155,25 @@ struct bl_pata_identification {
 	__u16	unused1[3];
 	__u8	firmware_revision[8];			/* Word 23-26 */
 	__u8	model_number[40];			/* Word 27-46 */
-	__u16	unused2[2];
+	__u16	max_multiple;				/* Word 47 */
+	__u16	unused2;
 	__u32	capabilities;				/* Word 49-50 */
-	__u16	unused3[9];
+	__u16	unused3[8];
+	__u16	multiple_setting;			/* Word 59 */
 	__u32	sectors_lba28;				/* Word 60-61 */
 	__u16	unused4[38];
 	__u64	sectors_lba48;				/* Word 100-103 */
 	__u16	unused5[152];
 } __attribute__((packed));
 
+#define BL_PATA_ID_CAP_DMA	(1 << 8)
+
+/* Sectors per DRQ block of READ MULTIPLE (words 47 & 59, bits 7:0). */
+#define BL_PATA_ID_MULTIPLE(w)	((w) & 0xff)
+
+/* Sector count register limits - 0 stands for the maximum. */
+#define BL_PATA_LBA28_MAX_SECTORS	0x100
+#define BL_PATA_LBA48_MAX_SECTORS	0x10000
+
 #endif
 
@@ -0,0 +1,527 @@
+#include "uas.h"
+#include "include/string.h"
+#include "include/bl-utils.h"
+#include "core/include/loader/loader.h"
+#include "core/include/storage/storage.h"
+#include "core/include/storage/scsi.h"
+#include "core/include/usb/usb.h"
+#include "core/include/memory/heap.h"
+
+BL_MODULE_NAME("USB Attached SCSI");
+
+/*
+ * Every command is tagged. Without streams (high speed), the device tells through
+ * the status pipe (READ READY) which one the next data transfer belongs to. With
+ * streams (SuperSpeed), data and status of a command go on the stream of its tag.
+ * Either way several commands are queued on the device at once, even though the
+ * host controllers only do one synchronous bulk transfer at a time.
+ */
+
+struct bl_uas_command {
+	int active;
+
+	bl_uint8_t *buf;
+	bl_size_t length;
+};
+
+struct bl_uas_device {
+	struct bl_usb_device *device;
+
+	int interface;
+	int alternate_setting;
+
+	/* Indexed by pipe ID - 1. */
+	struct bl_usb_endpoint_descriptor descriptors[BL_UAS_PIPES];
+	struct bl_usb_endpoint pipes[BL_UAS_PIPES];
+
+	/* Streams the device supports on each pipe, from the SuperSpeed companion. */
+	int max_streams[BL_UAS_PIPES];
+
+	/* Streams in use, commands complete in issue order then. */
+	int streams;
+	int next_tag;
+
+	struct bl_uas_command commands[BL_UAS_MAX_COMMANDS];
+};
+
+static inline struct bl_usb_endpoint *bl_uas_pipe(struct bl_uas_device *uas, int pipe_id)
+{
+	return &uas->pipes[pipe_id - 1];
+}
+
+static bl_status_t bl_uas_find_interface(struct bl_uas_device *uas)
+{
+	int i, off, match, max_streams;
+	bl_uint8_t *config_data, *desc, *endpoint;
+	struct bl_usb_configuration_descriptor config;
+	struct bl_usb_interface_descriptor *interface;
+	struct bl_uas_pipe_usage_descriptor *usage;
+	struct bl_usb_superspeed_endpoint_companion_descriptor *companion;
+
+	/* UAS is usually an alternate setting, which isn't kept by the USB core. */
+	bl_usb_get_descriptor(uas->device, 0, BL_USB_DESCRIPTOR_TYPE_CONFIG, 0, 0,
+		&config, sizeof(struct bl_usb_configuration_descriptor));
+
+	config_data = bl_heap_alloc(config.total_length);
+	if (!config_data)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	bl_usb_get_descriptor(uas->device, 0, BL_USB_DESCRIPTOR_TYPE_CONFIG, 0, 0,
+		config_data, config.total_length);
+
+	bl_memset(uas->descriptors, 0, sizeof(uas->descriptors));
+
+	match = 0;
+	max_streams = 0;
+	endpoint = NULL;
+	for (off = config.length; off + 2 <= config.total_length; off += desc[0]) {
+		desc = config_data + off;
+		if (desc[0] < 2)
+			break;
+
+		switch (desc[1]) {
+		case BL_USB_DESCRIPTOR_TYPE_INTERFACE:
+			/* Stop at the end of the first UAS interface. */
+			if (match)
+				goto _out;
+
+			interface = (struct bl_usb_interface_descriptor *)desc;
+			match = interface->interface_class == BL_UAS_INTERFACE_CLASS &&
+				interface->interface_subclass == BL_UAS_INTERFACE_SUBCLASS &&
+				interface->interface_protocol == BL_UAS_INTERFACE_PROTOCOL;
+
+			if (match) {
+				uas->interface = interface->interface_number;
+				uas->alternate_setting = interface->alternate_setting;
+			}
+
+			endpoint = NULL;
+			break;
+
+		case BL_USB_DESCRIPTOR_TYPE_ENDPOINT:
+			endpoint = desc;
+			max_streams = 0;
+			break;
+
+		case BL_USB_DESCRIPTOR_TYPE_SUPERSPEED_USB_ENDPOINT_COMPANION:
+			companion = (struct bl_usb_superspeed_endpoint_companion_descriptor *)desc;
+			max_streams = 1 << BL_USB_SS_COMPANION_MAX_STREAMS(companion->attributes);
+			break;
+
+		case BL_UAS_DESCRIPTOR_TYPE_PIPE_USAGE:
+			usage = (struct bl_uas_pipe_usage_descriptor *)desc;
+			if (!match || !endpoint || usage->pipe_id < BL_UAS_PIPE_COMMAND ||
+					usage->pipe_id > BL_UAS_PIPE_DATA_OUT)
+				break;
+
+			bl_memcpy(&uas->descriptors[usage->pipe_id - 1], endpoint,
+				sizeof(struct bl_usb_endpoint_descriptor));
+			uas->max_streams[usage->pipe_id - 1] = max_streams;
+			break;
+		}
+	}
+
+_out:
+	bl_heap_free(config_data, config.total_length);
+
+	for (i = 0; i < BL_UAS_PIPES; i++)
+		if (uas->descriptors[i].descriptor_type != BL_USB_DESCRIPTOR_TYPE_ENDPOINT)
+			return BL_STATUS_USB_INVALID_DEVICE;
+
+	return BL_STATUS_SUCCESS;
+}
+
+static void bl_uas_set_interface(struct bl_uas_device *uas, int alternate_setting)
+{
+	bl_usb_control_transfer(uas->device, NULL,
+		BL_USB_SETUP_REQUEST_TYPE_HOST_TO_DEVICE |
+		BL_USB_SETUP_REQUEST_TYPE_STANDARD |
+		BL_USB_SETUP_REQUEST_TYPE_RECIPIENT_INTERFACE,
+		BL_USB_REQUEST_TYPE_SET_INTERFACE, alternate_setting, uas->interface, 0);
+}
+
+static void bl_uas_issue_command(struct bl_uas_device *uas, int tag, void *cdb,
+	bl_uint8_t cdb_length, bl_uint8_t *buf, bl_size_t length)
+{
+	struct bl_uas_command_iu iu;
+
+	uas->commands[tag - 1].active = 1;
+	uas->commands[tag - 1].buf = buf;
+	uas->commands[tag - 1].length = length;
+
+	bl_memset(&iu, 0, sizeof(struct bl_uas_command_iu));
+
+	iu.iu_id = BL_UAS_IU_COMMAND;
+	iu.tag = cpu_to_be16(tag);
+	bl_memcpy(iu.cdb, cdb, cdb_length);
+
+	bl_usb_endpoint_bulk_transfer(uas->device, bl_uas_pipe(uas, BL_UAS_PIPE_COMMAND),
+		&iu, sizeof(struct bl_uas_command_iu));
+}
+
+/* Data and status of the command come on the stream of its tag. */
+static bl_status_t bl_uas_wait_stream(struct bl_uas_device *uas, int tag)
+{
+	union bl_uas_status_iu iu;
+	struct bl_uas_command *command;
+
+	command = &uas->commands[tag - 1];
+
+	if (command->length) {
+		bl_uas_pipe(uas, BL_UAS_PIPE_DATA_IN)->stream_id = tag;
+
+		bl_usb_endpoint_bulk_transfer(uas->device,
+			bl_uas_pipe(uas, BL_UAS_PIPE_DATA_IN), command->buf, command->length);
+	}
+
+	bl_memset(&iu, 0, sizeof(union bl_uas_status_iu));
+
+	bl_uas_pipe(uas, BL_UAS_PIPE_STATUS)->stream_id = tag;
+
+	bl_usb_endpoint_bulk_transfer(uas->device, bl_uas_pipe(uas, BL_UAS_PIPE_STATUS),
+		&iu, sizeof(union bl_uas_status_iu));
+
+	command->active = 0;
+
+	if (be16_to_cpu(iu.header.tag) != tag || iu.header.iu_id != BL_UAS_IU_SENSE)
+		return BL_STATUS_USB_INTERNAL_ERROR;
+
+	if (iu.sense.status != BL_SCSI_STATUS_GOOD)
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+
+	return BL_STATUS_SUCCESS;
+}
+
+/* Wait for any command to complete, moving data whenever the device asks for it. */
+static bl_status_t bl_uas_wait_any(struct bl_uas_device *uas, int *tag)
+{
+	int i;
+	union bl_uas_status_iu iu;
+	struct bl_uas_command *command;
+
+	/* Streams are served one at a time, so wait for the oldest command. */
+	if (uas->streams) {
+		for (i = 0; i < BL_UAS_MAX_COMMANDS; i++) {
+			*tag = (uas->next_tag + i - 1) % BL_UAS_MAX_COMMANDS + 1;
+			if (uas->commands[*tag - 1].active)
+				break;
+		}
+
+		if (i == BL_UAS_MAX_COMMANDS)
+			return BL_STATUS_USB_INTERNAL_ERROR;
+
+		uas->next_tag = *tag % BL_UAS_MAX_COMMANDS + 1;
+
+		return bl_uas_wait_stream(uas, *tag);
+	}
+
+	while (1) {
+		bl_memset(&iu, 0, sizeof(union bl_uas_status_iu));
+
+		bl_usb_endpoint_bulk_transfer(uas->device, bl_uas_pipe(uas, BL_UAS_PIPE_STATUS),
+			&iu, sizeof(union bl_uas_status_iu));
+
+		*tag = be16_to_cpu(iu.header.tag);
+		if (*tag < 1 || *tag > BL_UAS_MAX_COMMANDS || !uas->commands[*tag - 1].active)
+			return BL_STATUS_USB_INTERNAL_ERROR;
+
+		command = &uas->commands[*tag - 1];
+
+		switch (iu.header.iu_id) {
+		case BL_UAS_IU_READ_READY:
+			bl_usb_endpoint_bulk_transfer(uas->device,
+				bl_uas_pipe(uas, BL_UAS_PIPE_DATA_IN), command->buf, command->length);
+			break;
+
+		case BL_UAS_IU_SENSE:
+			command->active = 0;
+
+			if (iu.sense.status != BL_SCSI_STATUS_GOOD)
+				return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+
+			return BL_STATUS_SUCCESS;
+
+		default:
+			command->active = 0;
+			return BL_STATUS_USB_INTERNAL_ERROR;
+		}
+	}
+}
+
+static void bl_uas_abort_commands(struct bl_uas_device *uas)
+{
+	int i;
+
+	for (i = 0; i < BL_UAS_MAX_COMMANDS; i++)
+		uas->commands[i].active = 0;
+
+	uas->next_tag = 1;
+}
+
+static bl_status_t bl_uas_execute_command(struct bl_uas_device *uas, void *cdb,
+	bl_uint8_t cdb_length, void *buf, bl_size_t length)
+{
+	int tag;
+	bl_status_t status;
+
+	uas->next_tag = 1;
+
+	bl_uas_issue_command(uas, 1, cdb, cdb_length, buf, length);
+
+	status = bl_uas_wait_any(uas, &tag);
+	if (status)
+		bl_uas_abort_commands(uas);
+
+	return status;
+}
+
+/* Sectors moved per command, as much as the host controller takes at once. */
+static bl_uint64_t bl_uas_max_sectors(struct bl_uas_device *uas, bl_size_t sector_size)
+{
+	bl_size_t max_transfer;
+
+	max_transfer = BL_UAS_MAX_TRANSFER;
+	if (uas->device->controller->max_bulk_packets)
+		max_transfer = uas->device->controller->max_bulk_packets *
+			bl_uas_pipe(uas, BL_UAS_PIPE_DATA_IN)->descriptor->max_packet_size;
+
+	return BL_MAX(max_transfer / sector_size, 1);
+}
+
+/* Queue the next part of the read under the given tag. */
+static bl_uint64_t bl_uas_issue_read(struct bl_uas_device *uas, int tag, bl_uint8_t *buf,
+	bl_uint64_t lba, bl_uint64_t sectors, bl_size_t sector_size)
+{
+	struct bl_scsi_read10 cmd10;
+	struct bl_scsi_read16 cmd16;
+
+	if (lba + sectors - 1 <= BL_SCSI_READ10_MAX_LBA) {
+		sectors = BL_MIN(sectors, BL_SCSI_READ10_MAX_SECTORS);
+
+		bl_memset(&cmd10, 0, sizeof(struct bl_scsi_read10));
+
+		cmd10.opcode = BL_SCSI_COMMAND_READ10;
+		cmd10.lba = cpu_to_be32(lba & 0xffffffff);
+		cmd10.tranfser_length = cpu_to_be16(sectors & 0xffff);
+
+		bl_uas_issue_command(uas, tag, &cmd10, sizeof(struct bl_scsi_read10),
+			buf, sectors * sector_size);
+	} else {
+		bl_memset(&cmd16, 0, sizeof(struct bl_scsi_read16));
+
+		cmd16.opcode = BL_SCSI_COMMAND_READ16;
+		cmd16.lba = cpu_to_be64(lba);
+		cmd16.tranfser_length = cpu_to_be32(sectors & 0xffffffff);
+
+		bl_uas_issue_command(uas, tag, &cmd16, sizeof(struct bl_scsi_read16),
+			buf, sectors * sector_size);
+	}
+
+	return sectors;
+}
+
+static bl_status_t bl_uas_read(struct bl_storage_device *disk, bl_uint8_t *buf,
+	bl_uint64_t lba, bl_uint64_t sectors)
+{
+	int tag, tags, in_flight;
+	bl_status_t status;
+	bl_uint64_t count, max_sectors;
+	struct bl_uas_device *uas;
+
+	uas = ((struct bl_usb_device *)disk->data)->specific.storage.transport;
+
+	max_sectors = bl_uas_max_sectors(uas, disk->sector_size);
+
+	/* Each tag needs its own stream. */
+	tags = uas->streams ? uas->streams : BL_UAS_MAX_COMMANDS;
+	uas->next_tag = 1;
+
+	/* Fill the device queue, then keep it full as commands complete. */
+	for (tag = 1, in_flight = 0; tag <= tags && sectors; tag++) {
+		count = bl_uas_issue_read(uas, tag, buf, lba, BL_MIN(sectors, max_sectors),
+			disk->sector_size);
+
+		buf += count * disk->sector_size;
+		lba += count;
+		sectors -= count;
+		in_flight++;
+	}
+
+	while (in_flight) {
+		status = bl_uas_wait_any(uas, &tag);
+		if (status) {
+			bl_uas_abort_commands(uas);
+			return status;
+		}
+
+		in_flight--;
+
+		if (sectors) {
+			count = bl_uas_issue_read(uas, tag, buf, lba, BL_MIN(sectors, max_sectors),
+				disk->sector_size);
+
+			buf += count * disk->sector_size;
+			lba += count;
+			sectors -= count;
+			in_flight++;
+		}
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_uas_get_size(struct bl_uas_device *uas, bl_uint64_t *sector_count,
+	bl_size_t *sector_size)
+{
+	bl_status_t status;
+	struct bl_scsi_read_capacity10 cmd1;
+	struct bl_scsi_read_capacity10_data data1;
+	struct bl_scsi_read_capacity16 cmd2;
+	struct bl_scsi_read_capacity16_data data2;
+
+	bl_memset(&cmd1, 0, sizeof(struct bl_scsi_read_capacity10));
+
+	cmd1.opcode = BL_SCSI_COMMAND_READ_CAPACITY10;
+
+	status = bl_uas_execute_command(uas, &cmd1, sizeof(struct bl_scsi_read_capacity10),
+		&data1, sizeof(struct bl_scsi_read_capacity10_data));
+	if (status)
+		return status;
+
+	if (data1.lba != 0xffffffff) {
+		*sector_count = be32_to_cpu(data1.lba) + 1;
+		*sector_size = be32_to_cpu(data1.block_size);
+
+		return BL_STATUS_SUCCESS;
+	}
+
+	bl_memset(&cmd2, 0, sizeof(struct bl_scsi_read_capacity16));
+
+	cmd2.opcode = BL_SCSI_COMMAND_READ_CAPACITY16;
+	cmd2.allocation_length = cpu_to_be32(sizeof(struct bl_scsi_read_capacity16_data));
+
+	status = bl_uas_execute_command(uas, &cmd2, sizeof(struct bl_scsi_read_capacity16),
+		&data2, sizeof(struct bl_scsi_read_capacity16_data));
+	if (status)
+		return status;
+
+	*sector_count = be64_to_cpu(data2.lba) + 1;
+	*sector_size = be32_to_cpu(data2.block_size);
+
+	return BL_STATUS_SUCCESS;
+}
+
+/* A stream for each tag, on every pipe that carries data or status. */
+static bl_status_t bl_uas_alloc_streams(struct bl_uas_device *uas)
+{
+	int streams;
+	bl_status_t status;
+
+	uas->streams = BL_MIN(BL_MIN(uas->max_streams[BL_UAS_PIPE_DATA_IN - 1],
+		uas->max_streams[BL_UAS_PIPE_STATUS - 1]), BL_UAS_MAX_COMMANDS);
+	if (!uas->streams)
+		return BL_STATUS_UNSUPPORTED;
+
+	streams = uas->streams;
+	status = bl_usb_endpoint_alloc_streams(uas->device, bl_uas_pipe(uas, BL_UAS_PIPE_DATA_IN),
+		&streams);
+	if (status)
+		return status;
+
+	uas->streams = BL_MIN(uas->streams, streams);
+
+	streams = uas->streams;
+	status = bl_usb_endpoint_alloc_streams(uas->device, bl_uas_pipe(uas, BL_UAS_PIPE_STATUS),
+		&streams);
+	if (status)
+		return status;
+
+	uas->streams = BL_MIN(uas->streams, streams);
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_uas_get_info(struct bl_storage_device *disk)
+{
+	int i;
+	bl_status_t status;
+	struct bl_usb_device *device;
+	struct bl_uas_device *uas;
+
+	device = disk->data;
+
+	uas = bl_heap_alloc(sizeof(struct bl_uas_device));
+	if (!uas)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	bl_memset(uas, 0, sizeof(struct bl_uas_device));
+	uas->device = device;
+	uas->next_tag = 1;
+
+	status = bl_uas_find_interface(uas);
+	if (status)
+		goto _exit;
+
+	for (i = 0; i < BL_UAS_PIPES; i++) {
+		uas->pipes[i].toggle = 0;
+		uas->pipes[i].descriptor = &uas->descriptors[i];
+	}
+
+	bl_uas_set_interface(uas, uas->alternate_setting);
+
+	/* SuperSpeed UAS uses streams on the data and status pipes. */
+	if (device->speed >= BL_USB_SUPER_SPEED) {
+		status = bl_uas_alloc_streams(uas);
+		if (status) {
+			bl_uas_set_interface(uas, 0);
+			goto _exit;
+		}
+	}
+
+	status = bl_uas_get_size(uas, &disk->sector_count, &disk->sector_size);
+	if (status) {
+		/* Leave the device to Bulk-Only. */
+		bl_uas_set_interface(uas, 0);
+		goto _exit;
+	}
+
+	device->specific.storage.type = BL_USB_STORAGE_UAS;
+	device->specific.storage.transport = uas;
+
+	return BL_STATUS_SUCCESS;
+
+_exit:
+	bl_heap_free(uas, sizeof(struct bl_uas_device));
+
+	return status;
+}
+
+static struct bl_disk_controller_functions bl_uas_funcs = {
+	.type = BL_DISK_CONTROLLER_TYPE_USB_UAS,
+	.read = bl_uas_read,
+	.readv = NULL,
+	.submit = NULL,
+	.poll = NULL,
+	.get_info = bl_uas_get_info,
+};
+
+BL_MODULE_INIT()
+{
+	struct bl_disk_controller *bl_uas;
+
+	bl_uas = bl_heap_alloc(sizeof(struct bl_disk_controller));
+	if (!bl_uas)
+		return;
+
+	bl_uas->funcs = &bl_uas_funcs;
+	bl_uas->data = NULL;
+	bl_uas->probe_us = 0;
+	bl_uas->next = NULL;
+
+	bl_disk_controller_register(bl_uas);
+}
+
+BL_MODULE_UNINIT()
+{
+
+}
@@ -0,0 +1,91 @@
+#ifndef BL_UAS_H
+#define BL_UAS_H
+
+#include "include/bl-types.h"
+
+/* Mass storage interface using UAS. */
+#define BL_UAS_INTERFACE_CLASS		0x08
+#define BL_UAS_INTERFACE_SUBCLASS	0x06
+#define BL_UAS_INTERFACE_PROTOCOL	0x62
+
+/* Class specific descriptor following each UAS endpoint. */
+#define BL_UAS_DESCRIPTOR_TYPE_PIPE_USAGE	0x24
+
+struct bl_uas_pipe_usage_descriptor {
+	__u8	length;
+	__u8	descriptor_type;
+	__u8	pipe_id;
+	__u8	reserved0;
+} __attribute__((packed));
+
+/* Pipe IDs. */
+enum {
+	BL_UAS_PIPE_COMMAND	= 1,
+	BL_UAS_PIPE_STATUS	= 2,
+	BL_UAS_PIPE_DATA_IN	= 3,
+	BL_UAS_PIPE_DATA_OUT	= 4,
+};
+
+#define BL_UAS_PIPES	4
+
+/* Information unit IDs. */
+enum {
+	BL_UAS_IU_COMMAND	= 0x01,
+	BL_UAS_IU_SENSE		= 0x03,
+	BL_UAS_IU_RESPONSE	= 0x04,
+	BL_UAS_IU_TASK_MGMT	= 0x05,
+	BL_UAS_IU_READ_READY	= 0x06,
+	BL_UAS_IU_WRITE_READY	= 0x07,
+};
+
+struct bl_uas_command_iu {
+	__u8	iu_id;
+	__u8	reserved0;
+	__u16	tag;
+	__u8	attributes;
+	__u8	reserved1;
+	__u8	add_cdb_length;
+	__u8	reserved2;
+	__u64	lun;
+	__u8	cdb[16];
+} __attribute__((packed));
+
+struct bl_uas_iu_header {
+	__u8	iu_id;
+	__u8	reserved0;
+	__u16	tag;
+} __attribute__((packed));
+
+struct bl_uas_sense_iu {
+	__u8	iu_id;
+	__u8	reserved0;
+	__u16	tag;
+	__u16	status_qualifier;
+	__u8	status;
+	__u8	reserved1[7];
+	__u16	sense_length;
+	__u8	sense[18];
+} __attribute__((packed));
+
+struct bl_uas_response_iu {
+	__u8	iu_id;
+	__u8	reserved0;
+	__u16	tag;
+	__u8	additional_response_info[3];
+	__u8	response_code;
+} __attribute__((packed));
+
+/* Anything the status pipe may return. */
+union bl_uas_status_iu {
+	struct bl_uas_iu_header header;
+	struct bl_uas_sense_iu sense;
+	struct bl_uas_response_iu response;
+};
+
+/* Commands kept outstanding on the device, tags are 1..N. */
+#define BL_UAS_MAX_COMMANDS	4
+
+/* Data per command when host controller doesn't limit it. */
+#define BL_UAS_MAX_TRANSFER	0x10000
+
+#endif
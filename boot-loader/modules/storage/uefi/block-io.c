@@ -0,0 +1,276 @@
+#include "block-io.h"
+#include "core/firmware/uefi/include/utils.h"
+#include "include/string.h"
+#include "include/bl-utils.h"
+#include "core/include/loader/loader.h"
+#include "core/include/storage/storage.h"
+#include "core/include/memory/heap.h"
+
+BL_MODULE_NAME("EFI Block I/O Protocol");
+
+struct bl_block_io_device {
+	struct efi_block_io_protocol *bio;
+
+	/* Optional, used for asynchronous requests. */
+	struct efi_block_io2_protocol *bio2;
+	struct efi_block_io2_token tokens[BL_BLOCK_IO_MAX_REQUESTS];
+
+	/* Slots in use, and those whose read was done synchronously. */
+	bl_uint32_t busy;
+	bl_uint32_t done;
+	bl_status_t results[BL_BLOCK_IO_MAX_REQUESTS];
+
+	/* Only when the firmware needs more than BL_STORAGE_DMA_ALIGN. */
+	bl_uint8_t *bounce;
+};
+
+static inline bl_status_t bl_block_io_status(efi_status_t status)
+{
+	return EFI_FAILED(status) ? BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR :
+		BL_STATUS_SUCCESS;
+}
+
+static inline int bl_block_io_aligned(struct bl_block_io_device *device, void *buf)
+{
+	efi_uint32_t io_align;
+
+	io_align = device->bio->media->io_align;
+
+	return io_align <= 1 || !((bl_addr_t)buf & (io_align - 1));
+}
+
+static bl_status_t bl_block_io_read(struct bl_storage_device *disk, bl_uint8_t *buf,
+	bl_uint64_t lba, bl_uint64_t sectors)
+{
+	bl_uint64_t count;
+	efi_status_t status;
+	struct bl_block_io_device *device;
+	struct efi_block_io_protocol *bio;
+
+	device = disk->data;
+	bio = device->bio;
+
+	while (sectors) {
+		if (bl_block_io_aligned(device, buf)) {
+			count = BL_MIN(sectors, BL_BLOCK_IO_MAX_SECTORS);
+
+			status = bio->read_blocks(bio, bio->media->media_id, lba,
+				count * BL_STORAGE_SECTOR_SIZE, buf);
+			if (EFI_FAILED(status))
+				return bl_block_io_status(status);
+		} else {
+			count = BL_MIN(sectors, BL_BLOCK_IO_BOUNCE_SECTORS);
+
+			status = bio->read_blocks(bio, bio->media->media_id, lba,
+				count * BL_STORAGE_SECTOR_SIZE, device->bounce);
+			if (EFI_FAILED(status))
+				return bl_block_io_status(status);
+
+			bl_memcpy(buf, device->bounce, count * BL_STORAGE_SECTOR_SIZE);
+		}
+
+		buf += count * BL_STORAGE_SECTOR_SIZE;
+		lba += count;
+		sectors -= count;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_block_io_submit(struct bl_storage_device *disk,
+	struct bl_storage_request *request)
+{
+	int slot;
+	efi_status_t status;
+	struct bl_block_io_device *device;
+	struct efi_block_io2_protocol *bio2;
+
+	device = disk->data;
+	bio2 = device->bio2;
+
+	for (slot = 0; slot < BL_BLOCK_IO_MAX_REQUESTS; slot++)
+		if (!(device->busy & (1 << slot)))
+			break;
+
+	if (slot == BL_BLOCK_IO_MAX_REQUESTS)
+		return BL_STATUS_INSUFFICIENT_RESOURCES;
+
+	/* Anything Block I/O 2 can't take in one go is read right away. */
+	if (!bio2 || !bl_block_io_aligned(device, request->buf) ||
+			request->sectors > BL_BLOCK_IO_MAX_SECTORS) {
+		device->results[slot] = bl_block_io_read(disk, request->buf, request->lba,
+			request->sectors);
+		device->done |= (1 << slot);
+	} else {
+		device->tokens[slot].transaction_status = EFI_SUCCESS;
+
+		status = bio2->read_blocks_ex(bio2, bio2->media->media_id, request->lba,
+			&device->tokens[slot], request->sectors * BL_STORAGE_SECTOR_SIZE,
+			request->buf);
+		if (EFI_FAILED(status))
+			return bl_block_io_status(status);
+	}
+
+	device->busy |= (1 << slot);
+	request->tag = slot;
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_block_io_poll(struct bl_storage_device *disk,
+	struct bl_storage_request *request)
+{
+	int slot;
+	struct bl_block_io_device *device;
+
+	device = disk->data;
+	slot = request->tag;
+
+	if (!(device->done & (1 << slot))) {
+		if (bl_efi_check_event(device->tokens[slot].event) == EFI_NOT_READY)
+			return BL_STATUS_DISK_OPERATION_NOT_FINISHED;
+
+		device->results[slot] = bl_block_io_status(device->tokens[slot].transaction_status);
+	}
+
+	device->busy &= ~(1 << slot);
+	device->done &= ~(1 << slot);
+
+	return device->results[slot];
+}
+
+/* Events the firmware signals on completion, checked when polling. */
+static bl_status_t bl_block_io_create_events(struct bl_block_io_device *device)
+{
+	int i;
+	efi_status_t status;
+	efi_event_t event;
+
+	for (i = 0; i < BL_BLOCK_IO_MAX_REQUESTS; i++) {
+		status = bl_efi_create_event(0, EFI_TPL_CALLBACK, NULL, NULL, &event);
+		if (EFI_FAILED(status))
+			goto _failed;
+
+		device->tokens[i].event = event;
+	}
+
+	return BL_STATUS_SUCCESS;
+
+_failed:
+	while (i--)
+		bl_efi_close_event(device->tokens[i].event);
+
+	return BL_STATUS_FAILURE;
+}
+
+static struct bl_block_io_device *bl_block_io_device_create(efi_handle_t handle)
+{
+	efi_status_t status;
+	efi_guid_t bio_guid = EFI_BLOCK_IO_PROTOCOL_GUID,
+		bio2_guid = EFI_BLOCK_IO2_PROTOCOL_GUID;
+	struct efi_block_io_protocol *bio;
+	struct bl_block_io_device *device;
+
+	status = bl_efi_open_protocol(handle, &bio_guid, (void **)&bio,
+		EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+	if (EFI_FAILED(status))
+		return NULL;
+
+	/* Whole disks only, partitions are found by the partition table modules. */
+	if (!bio->media->media_present || bio->media->logical_partition ||
+			bio->media->block_size != BL_STORAGE_SECTOR_SIZE)
+		return NULL;
+
+	device = bl_heap_alloc(sizeof(struct bl_block_io_device));
+	if (!device)
+		return NULL;
+
+	device->bio = bio;
+	device->busy = 0;
+	device->done = 0;
+	device->bounce = NULL;
+
+	if (bio->media->io_align > BL_STORAGE_DMA_ALIGN) {
+		device->bounce = bl_heap_alloc_align(BL_BLOCK_IO_BOUNCE_SECTORS *
+			BL_STORAGE_SECTOR_SIZE, bio->media->io_align);
+		if (!device->bounce)
+			goto _failed;
+	}
+
+	status = bl_efi_open_protocol(handle, &bio2_guid, (void **)&device->bio2,
+		EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+	if (EFI_FAILED(status) || bl_block_io_create_events(device))
+		device->bio2 = NULL;
+
+	return device;
+
+_failed:
+	bl_heap_free(device, sizeof(struct bl_block_io_device));
+
+	return NULL;
+}
+
+static struct bl_disk_controller_functions block_io_functions = {
+	.type = BL_DISK_CONTROLLER_TYPE_UEFI_BLOCK_IO,
+	.read = bl_block_io_read,
+	.readv = NULL,
+	.submit = bl_block_io_submit,
+	.poll = bl_block_io_poll,
+	.get_info = NULL,
+};
+
+BL_MODULE_INIT()
+{
+	efi_status_t status;
+	efi_uintn_t i, no_handles;
+	efi_guid_t bio_guid = EFI_BLOCK_IO_PROTOCOL_GUID;
+	efi_handle_t *handles;
+	struct bl_block_io_device *device;
+	struct bl_disk_controller *controller;
+
+	status = bl_efi_locate_handle_buffer(EFI_BY_PROTOCOL, &bio_guid,
+		NULL, &no_handles, &handles);
+	if (EFI_FAILED(status))
+		return;
+
+	controller = bl_heap_alloc(sizeof(struct bl_disk_controller));
+	if (!controller)
+		return;
+
+	controller->funcs = &block_io_functions;
+	controller->data = NULL;
+	controller->probe_us = 0;
+	controller->next = NULL;
+
+	bl_disk_controller_register(controller);
+
+	for (i = 0; i < no_handles; i++) {
+		struct bl_storage_device *disk;
+
+		device = bl_block_io_device_create(handles[i]);
+		if (!device)
+			continue;
+
+		disk = bl_heap_alloc(sizeof(struct bl_storage_device));
+		if (!disk)
+			return;
+
+		disk->type = BL_STORAGE_TYPE_HARD_DRIVE;
+		disk->controller = controller;
+		disk->sector_size = BL_STORAGE_SECTOR_SIZE;
+		disk->sector_count = device->bio->media->last_block + 1;
+		disk->data = device;
+		disk->next = NULL;
+
+		bl_storage_device_register(disk);
+
+		/* Without Block I/O 2 requests complete while being submitted. */
+		bl_storage_device_set_queue_depth(disk, device->bio2 ?
+			BL_BLOCK_IO_MAX_REQUESTS : 1);
+	}
+}
+
+BL_MODULE_UNINIT()
+{
+
+}
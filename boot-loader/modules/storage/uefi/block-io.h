@@ -0,0 +1,15 @@
+#ifndef BL_BLOCK_IO_H
+#define BL_BLOCK_IO_H
+
+#include "include/bl-types.h"
+
+/* Outstanding Block I/O 2 reads per disk, slots are tracked in a 32-bit mask. */
+#define BL_BLOCK_IO_MAX_REQUESTS	8
+
+/* Largest single firmware read, keeps the byte count within a 32-bit UINTN. */
+#define BL_BLOCK_IO_MAX_SECTORS		0x10000
+
+/* Bounce buffer for reads into buffers the firmware's IoAlign rejects. */
+#define BL_BLOCK_IO_BOUNCE_SECTORS	64
+
+#endif
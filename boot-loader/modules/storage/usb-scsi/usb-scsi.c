@@ -1,5 +1,6 @@
 #include "usb-scsi.h"
 #include "include/string.h"
+#include "include/bl-utils.h"
 #include "core/include/loader/loader.h"
 #include "core/include/storage/storage.h"
 #include "core/include/usb/usb.h"
@@ -27,7 +28,7 @@ static void bl_usb_scsi_bbb_init_cbw(struct bl_usb_bbb_cbw *cbw, bl_uint8_t lun,
 	bl_memcpy(cbw->cmd, cmd, cbw->cb_length);
 }
 
-static bl_status_t bl_usb_scsi_bbb_execute_command(struct bl_usb_device *device, int direction,
+static bl_status_t bl_usb_scsi_bbb_transport(struct bl_usb_device *device, int direction,
 	void *cmd, bl_uint8_t cb_length, void *buf, bl_size_t length)
 {
 	struct bl_usb_bbb_cbw cbw;
@@ -38,9 +39,22 @@ static bl_status_t bl_usb_scsi_bbb_execute_command(struct bl_usb_device *device,
 	bl_usb_bulk_transfer(device, 1, &cbw, sizeof(struct bl_usb_bbb_cbw));
 	bl_usb_bulk_transfer(device, direction, buf, length);
 
+	bl_memset(&csw, 0, sizeof(struct bl_usb_bbb_csw));
 	bl_usb_bulk_transfer(device, 0, &csw, sizeof(struct bl_usb_bbb_csw));
 
-	return BL_STATUS_SUCCESS;
+	if (csw.signature != BL_USB_BBB_CSW_SIGNAUTE || csw.tag != cbw.tag)
+		return BL_STATUS_USB_INTERNAL_ERROR;
+
+	switch (csw.status) {
+	case BL_USB_BBB_CSW_STATUS_PASSED:
+		return BL_STATUS_SUCCESS;
+
+	case BL_USB_BBB_CSW_STATUS_FAILED:
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+
+	default:
+		return BL_STATUS_USB_INTERNAL_ERROR;
+	}
 }
 
 static bl_status_t bl_usb_scsi_sense_data(struct bl_usb_device *device)
@@ -54,14 +68,27 @@ static bl_status_t bl_usb_scsi_sense_data(struct bl_usb_device *device)
 	cmd.lun = (0 << 5);
 	cmd.allocation_length = sizeof(struct bl_scsi_request_sense_data);
 
-	return bl_usb_scsi_bbb_execute_command(device, 0, &cmd, sizeof(struct bl_scsi_request_sense),
+	return bl_usb_scsi_bbb_transport(device, 0, &cmd, sizeof(struct bl_scsi_request_sense),
 		&data, sizeof(struct bl_scsi_request_sense_data));
 }
 
+static bl_status_t bl_usb_scsi_bbb_execute_command(struct bl_usb_device *device, int direction,
+	void *cmd, bl_uint8_t cb_length, void *buf, bl_size_t length)
+{
+	bl_status_t status;
+
+	status = bl_usb_scsi_bbb_transport(device, direction, cmd, cb_length, buf, length);
+
+	/* Sense data is only interesting (and clears the condition) after a failure. */
+	if (status == BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR)
+		bl_usb_scsi_sense_data(device);
+
+	return status;
+}
+
 static bl_status_t bl_usb_scsi_read10(struct bl_usb_device *device, bl_uint8_t *buf,
 	bl_uint64_t lba, bl_uint64_t sectors, bl_size_t length)
 {
-	bl_status_t status;
 	struct bl_scsi_read10 cmd;
 
 	bl_memset(&cmd, 0, sizeof(struct bl_scsi_read10));
@@ -70,16 +97,23 @@ static bl_status_t bl_usb_scsi_read10(struct bl_usb_device *device, bl_uint8_t *
 	cmd.lba = cpu_to_be32(lba & 0xffffffff);
 	cmd.tranfser_length = cpu_to_be16(sectors & 0xffff);
 
-	status = bl_usb_scsi_bbb_execute_command(device, 0, &cmd, sizeof(struct bl_scsi_read10),
+	return bl_usb_scsi_bbb_execute_command(device, 0, &cmd, sizeof(struct bl_scsi_read10),
 		buf, length);
-	if (status)
-		return status;
+}
 
-	status = bl_usb_scsi_sense_data(device);
-	if (status)
-		return status;
+static bl_status_t bl_usb_scsi_read16(struct bl_usb_device *device, bl_uint8_t *buf,
+	bl_uint64_t lba, bl_uint64_t sectors, bl_size_t length)
+{
+	struct bl_scsi_read16 cmd;
 
-	return BL_STATUS_SUCCESS;
+	bl_memset(&cmd, 0, sizeof(struct bl_scsi_read16));
+
+	cmd.opcode = BL_SCSI_COMMAND_READ16;
+	cmd.lba = cpu_to_be64(lba);
+	cmd.tranfser_length = cpu_to_be32(sectors & 0xffffffff);
+
+	return bl_usb_scsi_bbb_execute_command(device, 0, &cmd, sizeof(struct bl_scsi_read16),
+		buf, length);
 }
 
 // TODO: Fix this.
@@ -87,7 +121,6 @@ static bl_status_t bl_usb_scsi_read10(struct bl_usb_device *device, bl_uint8_t *
 static bl_status_t bl_usb_scsi_read6(struct bl_usb_device *device, bl_uint8_t *buf,
 	bl_uint64_t lba, bl_uint64_t sectors, bl_size_t length)
 {
-	bl_status_t status;
 	struct bl_scsi_read6 cmd;
 	bl_uint16_t be_sectors;
 
@@ -102,36 +135,52 @@ static bl_status_t bl_usb_scsi_read6(struct bl_usb_device *device, bl_uint8_t *b
 
 	cmd.tranfser_length = sectors & 0xff;
 
-	status = bl_usb_scsi_bbb_execute_command(device, 0, &cmd, sizeof(struct bl_scsi_read6),
+	return bl_usb_scsi_bbb_execute_command(device, 0, &cmd, sizeof(struct bl_scsi_read6),
 		buf, length);
-	if (status)
-		return status;
+}
+#endif
 
-	status = bl_usb_scsi_sense_data(device);
-	if (status)
-		return status;
+/* Sectors moved per CBW, as much as the host controller takes at once. */
+static bl_uint64_t bl_usb_scsi_max_sectors(struct bl_usb_device *device, bl_size_t sector_size)
+{
+	bl_size_t max_transfer;
 
-	return BL_STATUS_SUCCESS;
+	max_transfer = BL_USB_SCSI_MAX_TRANSFER;
+	if (device->controller->max_bulk_packets)
+		max_transfer = device->controller->max_bulk_packets *
+			device->specific.storage.in_endp.descriptor->max_packet_size;
+
+	return BL_MAX(max_transfer / sector_size, 1);
 }
-#endif
 
 static bl_status_t bl_usb_scsi_read(struct bl_storage_device *disk, bl_uint8_t *buf,
 	bl_uint64_t lba, bl_uint64_t sectors)
 {
 	bl_status_t status;
+	bl_uint64_t count, max_sectors;
 	struct bl_usb_device *device;
 
 	device = disk->data;
 
-	//if (lba < (1 << 21) && sectors < (1 << 8)) {
-	//	status = bl_usb_scsi_read6(device, buf, lba, sectors, sectors * disk->sector_size);
-	//	if (status)
-	//		return status;
-	//} else {
-		status = bl_usb_scsi_read10(device, buf, lba, sectors, sectors * disk->sector_size);
+	max_sectors = bl_usb_scsi_max_sectors(device, disk->sector_size);
+
+	while (sectors) {
+		count = BL_MIN(sectors, max_sectors);
+
+		/* READ(10) is enough below 2 TiB. */
+		if (lba + count - 1 <= BL_SCSI_READ10_MAX_LBA) {
+			count = BL_MIN(count, BL_SCSI_READ10_MAX_SECTORS);
+			status = bl_usb_scsi_read10(device, buf, lba, count, count * disk->sector_size);
+		} else
+			status = bl_usb_scsi_read16(device, buf, lba, count, count * disk->sector_size);
+
 		if (status)
 			return status;
-	//}
+
+		buf += count * disk->sector_size;
+		lba += count;
+		sectors -= count;
+	}
 
 	return BL_STATUS_SUCCESS;
 }
@@ -156,10 +205,6 @@ static bl_status_t bl_usb_scsi_get_size(struct bl_usb_device *device, bl_uint64_
 	if (status)
 		return status;
 
-	status = bl_usb_scsi_sense_data(device);
-	if (status)
-		return status;
-
 	/* If the storage device capacity is large (really large!) then
 	   use the READ CAPACITY (16) command. */
 	if (data1.lba < 0xffffffff) {
@@ -180,10 +225,6 @@ static bl_status_t bl_usb_scsi_get_size(struct bl_usb_device *device, bl_uint64_
 	if (status)
 		return status;
 
-	status = bl_usb_scsi_sense_data(device);
-	if (status)
-		return status;
-
 	*sector_count = be64_to_cpu(data2.lba) + 1;
 	*sector_size = be32_to_cpu(data2.block_size);
 
@@ -210,10 +251,6 @@ static bl_status_t bl_usb_scsi_inquiry(struct bl_usb_device *device)
 	if (status)
 		return status;
 
-	status = bl_usb_scsi_sense_data(device);
-	if (status)
-		return status;
-
 	return BL_STATUS_SUCCESS;
 }
 
@@ -303,6 +340,9 @@ static bl_status_t bl_usb_scsi_get_info(struct bl_storage_device *disk)
 static struct bl_disk_controller_functions bl_usb_scsi_funcs = {
 	.type = BL_DISK_CONTROLLER_TYPE_USB_SCSI,
 	.read = bl_usb_scsi_read,
+	.readv = NULL,
+	.submit = NULL,
+	.poll = NULL,
 	.get_info = bl_usb_scsi_get_info,
 };
 
@@ -316,6 +356,7 @@ BL_MODULE_INIT()
 
 	bl_usb_scsi->funcs = &bl_usb_scsi_funcs;
 	bl_usb_scsi->data = NULL;
+	bl_usb_scsi->probe_us = 0;
 	bl_usb_scsi->next = NULL;
 
 	bl_disk_controller_register(bl_usb_scsi);
@@ -0,0 +1,670 @@
+#include "virtio-blk.h"
+#include "include/io.h"
+#include "include/time.h"
+#include "include/string.h"
+#include "include/bl-utils.h"
+#include "core/include/loader/loader.h"
+#include "core/include/storage/storage.h"
+#include "core/include/pci/pci.h"
+#include "core/include/memory/heap.h"
+
+BL_MODULE_NAME("Virtio Block Device");
+
+struct bl_virtio_blk_device {
+	/* Legacy devices are driven through I/O ports, modern through memory. */
+	int modern;
+	bl_port_t io;
+
+	volatile struct bl_virtio_pci_common_cfg *common;
+	volatile bl_uint8_t *device_cfg;
+	volatile bl_uint16_t *notify;
+
+	/* Split virtqueue 0. */
+	int queue_size;
+	volatile struct bl_virtq_desc *desc;
+	volatile struct bl_virtq_avail *avail;
+	volatile struct bl_virtq_used *used;
+	bl_uint16_t last_used;
+
+	/* Request slots - slot i owns descriptors 3i .. 3i + 2. */
+	int slots;
+	bl_uint32_t busy;
+	bl_uint32_t failed;
+	struct bl_virtio_blk_req_header *headers;
+	volatile bl_uint8_t *statuses;
+
+	bl_uint64_t capacity;
+	bl_uint64_t max_sectors;
+
+	struct bl_virtio_blk_device *next;
+};
+static struct bl_virtio_blk_device *bl_virtio_blk_device_list = NULL;
+
+static inline void bl_virtio_blk_device_add(struct bl_virtio_blk_device *device)
+{
+	device->next = bl_virtio_blk_device_list;
+	bl_virtio_blk_device_list = device;
+}
+
+static void bl_virtio_blk_set_status(struct bl_virtio_blk_device *device, bl_uint8_t status)
+{
+	if (device->modern)
+		device->common->device_status = status;
+	else
+		bl_outb(status, device->io + BL_VIRTIO_LEGACY_DEVICE_STATUS);
+}
+
+static bl_uint8_t bl_virtio_blk_get_status(struct bl_virtio_blk_device *device)
+{
+	if (device->modern)
+		return device->common->device_status;
+
+	return bl_inb(device->io + BL_VIRTIO_LEGACY_DEVICE_STATUS);
+}
+
+static bl_uint32_t bl_virtio_blk_read_config(struct bl_virtio_blk_device *device, int offset)
+{
+	if (device->modern)
+		return *(volatile bl_uint32_t *)(device->device_cfg + offset);
+
+	return bl_inl(device->io + BL_VIRTIO_LEGACY_DEVICE_CONFIG + offset);
+}
+
+static inline void bl_virtio_blk_notify(struct bl_virtio_blk_device *device)
+{
+	if (device->modern)
+		*device->notify = 0;
+	else
+		bl_outw(0, device->io + BL_VIRTIO_LEGACY_QUEUE_NOTIFY);
+}
+
+/* Accept only what is needed, returns the device features of the low word. */
+static bl_status_t bl_virtio_blk_negotiate(struct bl_virtio_blk_device *device,
+	bl_uint32_t *features)
+{
+	if (!device->modern) {
+		*features = bl_inl(device->io + BL_VIRTIO_LEGACY_DEVICE_FEATURES) &
+			(1 << BL_VIRTIO_BLK_F_SIZE_MAX);
+		bl_outl(*features, device->io + BL_VIRTIO_LEGACY_GUEST_FEATURES);
+
+		return BL_STATUS_SUCCESS;
+	}
+
+	device->common->device_feature_select = 0;
+	*features = device->common->device_feature & (1 << BL_VIRTIO_BLK_F_SIZE_MAX);
+
+	device->common->device_feature_select = 1;
+	if (!(device->common->device_feature & (1 << (BL_VIRTIO_F_VERSION_1 - 32))))
+		return BL_STATUS_UNSUPPORTED;
+
+	device->common->driver_feature_select = 0;
+	device->common->driver_feature = *features;
+	device->common->driver_feature_select = 1;
+	device->common->driver_feature = 1 << (BL_VIRTIO_F_VERSION_1 - 32);
+
+	bl_virtio_blk_set_status(device, bl_virtio_blk_get_status(device) |
+		BL_VIRTIO_STATUS_FEATURES_OK);
+
+	if (!(bl_virtio_blk_get_status(device) & BL_VIRTIO_STATUS_FEATURES_OK))
+		return BL_STATUS_UNSUPPORTED;
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_virtio_blk_setup_queue(struct bl_virtio_blk_device *device)
+{
+	int i, size;
+	bl_size_t avail_size, used_size;
+	bl_uint8_t *ring;
+
+	if (device->modern) {
+		device->common->queue_select = 0;
+		size = BL_MIN(device->common->queue_size, BL_VIRTIO_BLK_MAX_QUEUE_SIZE);
+	} else {
+		bl_outw(0, device->io + BL_VIRTIO_LEGACY_QUEUE_SELECT);
+		size = bl_inw(device->io + BL_VIRTIO_LEGACY_QUEUE_SIZE);
+	}
+
+	if (size < BL_VIRTIO_BLK_DESCS_PER_REQUEST)
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+
+	/* Legacy layout fits the modern requirements as well. */
+	avail_size = BL_MEMORY_ALIGN_UP(size * sizeof(struct bl_virtq_desc) +
+		sizeof(struct bl_virtq_avail) + (size + 1) * sizeof(bl_uint16_t), BL_VIRTQ_ALIGN);
+	used_size = BL_MEMORY_ALIGN_UP(sizeof(struct bl_virtq_used) +
+		size * sizeof(struct bl_virtq_used_elem) + sizeof(bl_uint16_t), BL_VIRTQ_ALIGN);
+
+	ring = bl_heap_alloc_align(avail_size + used_size, BL_VIRTQ_ALIGN);
+	if (!ring)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	bl_memset(ring, 0, avail_size + used_size);
+
+	device->queue_size = size;
+	device->desc = (void *)ring;
+	device->avail = (void *)(ring + size * sizeof(struct bl_virtq_desc));
+	device->used = (void *)(ring + avail_size);
+	device->last_used = 0;
+
+	device->slots = BL_MIN(size / BL_VIRTIO_BLK_DESCS_PER_REQUEST,
+		BL_VIRTIO_BLK_MAX_REQUESTS);
+	device->busy = 0;
+	device->failed = 0;
+
+	device->headers = bl_heap_alloc(device->slots * sizeof(struct bl_virtio_blk_req_header));
+	if (!device->headers)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	device->statuses = bl_heap_alloc(device->slots);
+	if (!device->statuses)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	/* Chains never change, only the data descriptor is filled per request. */
+	for (i = 0; i < device->slots; i++) {
+		volatile struct bl_virtq_desc *desc;
+
+		desc = &device->desc[i * BL_VIRTIO_BLK_DESCS_PER_REQUEST];
+
+		desc[0].addr = (bl_addr_t)&device->headers[i];
+		desc[0].len = sizeof(struct bl_virtio_blk_req_header);
+		desc[0].flags = BL_VIRTQ_DESC_F_NEXT;
+		desc[0].next = i * BL_VIRTIO_BLK_DESCS_PER_REQUEST + 1;
+
+		desc[1].flags = BL_VIRTQ_DESC_F_NEXT | BL_VIRTQ_DESC_F_WRITE;
+		desc[1].next = i * BL_VIRTIO_BLK_DESCS_PER_REQUEST + 2;
+
+		desc[2].addr = (bl_addr_t)&device->statuses[i];
+		desc[2].len = 1;
+		desc[2].flags = BL_VIRTQ_DESC_F_WRITE;
+		desc[2].next = 0;
+	}
+
+	if (device->modern) {
+		device->common->queue_size = size;
+		device->common->queue_desc = (bl_addr_t)device->desc;
+		device->common->queue_desc_hi = 0;
+		device->common->queue_driver = (bl_addr_t)device->avail;
+		device->common->queue_driver_hi = 0;
+		device->common->queue_device = (bl_addr_t)device->used;
+		device->common->queue_device_hi = 0;
+		device->common->queue_enable = 1;
+	} else
+		bl_outl((bl_addr_t)ring / BL_VIRTQ_ALIGN, device->io + BL_VIRTIO_LEGACY_QUEUE_ADDRESS);
+
+	return BL_STATUS_SUCCESS;
+}
+
+/* Take completed chains off the used ring. */
+static void bl_virtio_blk_reap(struct bl_virtio_blk_device *device)
+{
+	int slot;
+	volatile struct bl_virtq_used_elem *elem;
+
+	while (device->last_used != device->used->idx) {
+		elem = &device->used->ring[device->last_used % device->queue_size];
+		slot = elem->id / BL_VIRTIO_BLK_DESCS_PER_REQUEST;
+
+		device->busy &= ~(1 << slot);
+		if (device->statuses[slot] != BL_VIRTIO_BLK_S_OK)
+			device->failed |= (1 << slot);
+
+		device->last_used++;
+	}
+}
+
+static int bl_virtio_blk_free_slots(struct bl_virtio_blk_device *device)
+{
+	int i, count;
+
+	for (i = 0, count = 0; i < device->slots; i++)
+		if (!((device->busy | device->failed) & (1 << i)))
+			count++;
+
+	return count;
+}
+
+/* Put one request in the available ring, the device is notified by the caller. */
+static bl_status_t bl_virtio_blk_queue_request(struct bl_virtio_blk_device *device,
+	bl_uint8_t *buf, bl_uint64_t lba, bl_uint64_t sectors, bl_uint32_t *issued)
+{
+	int slot;
+	volatile struct bl_virtq_desc *desc;
+
+	for (slot = 0; slot < device->slots; slot++)
+		if (!((device->busy | device->failed) & (1 << slot)))
+			break;
+
+	if (slot == device->slots)
+		return BL_STATUS_INSUFFICIENT_RESOURCES;
+
+	device->headers[slot].type = BL_VIRTIO_BLK_T_IN;
+	device->headers[slot].reserved = 0;
+	device->headers[slot].sector = lba;
+	device->statuses[slot] = 0xff;
+
+	desc = &device->desc[slot * BL_VIRTIO_BLK_DESCS_PER_REQUEST];
+	desc[1].addr = (bl_addr_t)buf;
+	desc[1].len = sectors * BL_STORAGE_SECTOR_SIZE;
+
+	device->avail->ring[device->avail->idx % device->queue_size] =
+		slot * BL_VIRTIO_BLK_DESCS_PER_REQUEST;
+	device->avail->idx++;
+
+	device->busy |= (1 << slot);
+	*issued |= (1 << slot);
+
+	return BL_STATUS_SUCCESS;
+}
+
+/* Queue a read of any size, split to requests of max_sectors. */
+static bl_status_t bl_virtio_blk_queue_read(struct bl_virtio_blk_device *device,
+	bl_uint8_t *buf, bl_uint64_t lba, bl_uint64_t sectors, bl_uint32_t *issued)
+{
+	bl_uint64_t count;
+	bl_status_t status;
+
+	while (sectors) {
+		count = BL_MIN(sectors, device->max_sectors);
+
+		status = bl_virtio_blk_queue_request(device, buf, lba, count, issued);
+		if (status)
+			return status;
+
+		buf += count * BL_STORAGE_SECTOR_SIZE;
+		lba += count;
+		sectors -= count;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_virtio_blk_status(struct bl_virtio_blk_device *device, bl_uint32_t slots)
+{
+	bl_virtio_blk_reap(device);
+
+	if (device->busy & slots)
+		return BL_STATUS_DISK_OPERATION_NOT_FINISHED;
+
+	if (device->failed & slots) {
+		device->failed &= ~slots;
+		return BL_STATUS_DISK_CONTROLLER_INTERNAL_ERROR;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+/* Doesn't touch the failed slots, their requests still have to see the error. */
+static int bl_virtio_blk_slot_available(struct bl_virtio_blk_device *device)
+{
+	bl_virtio_blk_reap(device);
+
+	return bl_virtio_blk_free_slots(device) > 0;
+}
+
+static bl_status_t bl_virtio_blk_wait(struct bl_virtio_blk_device *device, bl_uint32_t slots)
+{
+	bl_status_t status;
+
+	if (!bl_poll_until((status = bl_virtio_blk_status(device, slots)) !=
+				BL_STATUS_DISK_OPERATION_NOT_FINISHED, BL_VIRTIO_BLK_TIMEOUT))
+		return BL_STATUS_DISK_OPERATION_TIMEOUT;
+
+	return status;
+}
+
+static bl_status_t bl_virtio_blk_read(struct bl_storage_device *disk, bl_uint8_t *buf,
+	bl_uint64_t lba, bl_uint64_t sectors)
+{
+	bl_uint32_t issued;
+	bl_uint64_t chunk;
+	bl_status_t status;
+	struct bl_virtio_blk_device *device;
+
+	device = disk->data;
+
+	while (sectors) {
+		bl_virtio_blk_reap(device);
+
+		/* Fill all free slots, then let the device have them with a single notify. */
+		chunk = BL_MIN(sectors, bl_virtio_blk_free_slots(device) * device->max_sectors);
+		if (!chunk) {
+			/* Every slot belongs to a request - wait for one without taking its status. */
+			if (!device->busy)
+				return BL_STATUS_INSUFFICIENT_RESOURCES;
+
+			if (!bl_poll_until(bl_virtio_blk_slot_available(device), BL_VIRTIO_BLK_TIMEOUT))
+				return BL_STATUS_DISK_OPERATION_TIMEOUT;
+
+			continue;
+		}
+
+		issued = 0;
+
+		status = bl_virtio_blk_queue_read(device, buf, lba, chunk, &issued);
+		bl_virtio_blk_notify(device);
+
+		if (status) {
+			bl_virtio_blk_wait(device, issued);
+			return status;
+		}
+
+		status = bl_virtio_blk_wait(device, issued);
+		if (status)
+			return status;
+
+		buf += chunk * BL_STORAGE_SECTOR_SIZE;
+		lba += chunk;
+		sectors -= chunk;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_virtio_blk_readv(struct bl_storage_device *disk,
+	struct bl_storage_segment *segments, int count)
+{
+	int i;
+	bl_uint32_t issued;
+	bl_uint64_t requests;
+	bl_status_t status;
+	struct bl_virtio_blk_device *device;
+
+	device = disk->data;
+
+	for (i = 0; i < count; ) {
+		bl_virtio_blk_reap(device);
+
+		/* Batch as many segments as there are free slots. */
+		issued = 0;
+		while (i < count) {
+			requests = segments[i].sectors / device->max_sectors +
+				((segments[i].sectors % device->max_sectors) > 0);
+			if (requests > bl_virtio_blk_free_slots(device))
+				break;
+
+			bl_virtio_blk_queue_read(device, segments[i].buf, segments[i].lba,
+				segments[i].sectors, &issued);
+			i++;
+		}
+
+		/* Only empty segments were left. */
+		if (!issued && i == count)
+			return BL_STATUS_SUCCESS;
+
+		/* Segment too large for all the slots together. */
+		if (!issued) {
+			status = bl_virtio_blk_read(disk, segments[i].buf, segments[i].lba,
+				segments[i].sectors);
+			if (status)
+				return status;
+
+			i++;
+			continue;
+		}
+
+		bl_virtio_blk_notify(device);
+
+		status = bl_virtio_blk_wait(device, issued);
+		if (status)
+			return status;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_virtio_blk_submit(struct bl_storage_device *disk,
+	struct bl_storage_request *request)
+{
+	bl_status_t status;
+	bl_uint64_t requests;
+	struct bl_virtio_blk_device *device;
+
+	device = disk->data;
+
+	bl_virtio_blk_reap(device);
+
+	/* All parts of the request are queued at once - tag holds their slots. */
+	requests = request->sectors / device->max_sectors +
+		((request->sectors % device->max_sectors) > 0);
+	if (requests > bl_virtio_blk_free_slots(device))
+		return BL_STATUS_INSUFFICIENT_RESOURCES;
+
+	request->tag = 0;
+
+	status = bl_virtio_blk_queue_read(device, request->buf, request->lba, request->sectors,
+		&request->tag);
+	bl_virtio_blk_notify(device);
+
+	if (status) {
+		bl_virtio_blk_wait(device, request->tag);
+		return status;
+	}
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_virtio_blk_poll(struct bl_storage_device *disk,
+	struct bl_storage_request *request)
+{
+	return bl_virtio_blk_status(disk->data, request->tag);
+}
+
+/* Map a structure pointed by a modern capability, only 32-bit memory BARs are reachable. */
+static volatile void *bl_virtio_blk_map_cap(struct bl_pci_index i, bl_uint8_t cap)
+{
+	int bar;
+	bl_uint32_t base_address;
+
+	bar = bl_pci_read_config_byte(i.bus, i.dev, i.func, cap + BL_VIRTIO_PCI_CAP_BAR);
+	if (bar > 5)
+		return NULL;
+
+	base_address = bl_pci_read_config_long(i.bus, i.dev, i.func,
+		BL_PCI_CONFIG_REG_BAR0 + bar * sizeof(bl_uint32_t));
+	if (base_address & BL_VIRTIO_PCI_BAR_IO)
+		return NULL;
+
+	if ((base_address & BL_VIRTIO_PCI_BAR_TYPE_64) && bar < 5 &&
+			bl_pci_read_config_long(i.bus, i.dev, i.func,
+				BL_PCI_CONFIG_REG_BAR0 + (bar + 1) * sizeof(bl_uint32_t)))
+		return NULL;
+
+	return (volatile void *)((base_address & BL_VIRTIO_PCI_BAR_MEM_BA) +
+		bl_pci_read_config_long(i.bus, i.dev, i.func, cap + BL_VIRTIO_PCI_CAP_OFFSET));
+}
+
+static bl_status_t bl_virtio_blk_find_caps(struct bl_pci_index i,
+	struct bl_virtio_blk_device *device)
+{
+	bl_uint8_t cap, notify_cap;
+	volatile bl_uint8_t *notify_base;
+
+	device->common = NULL;
+	device->device_cfg = NULL;
+	notify_cap = 0;
+	notify_base = NULL;
+
+	if (!(bl_pci_read_config_word(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_STATUS) &
+			BL_PCI_STATUS_CAPABILITIES_LIST))
+		return BL_STATUS_UNSUPPORTED;
+
+	cap = bl_pci_read_config_byte(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_CAPABILITIES);
+	for (; cap; cap = bl_pci_read_config_byte(i.bus, i.dev, i.func, cap + BL_VIRTIO_PCI_CAP_NEXT)) {
+		if (bl_pci_read_config_byte(i.bus, i.dev, i.func, cap) != BL_VIRTIO_PCI_CAP_ID_VENDOR)
+			continue;
+
+		switch (bl_pci_read_config_byte(i.bus, i.dev, i.func, cap + BL_VIRTIO_PCI_CAP_CFG_TYPE)) {
+		case BL_VIRTIO_PCI_CAP_COMMON_CFG:
+			if (!device->common)
+				device->common = bl_virtio_blk_map_cap(i, cap);
+			break;
+
+		case BL_VIRTIO_PCI_CAP_NOTIFY_CFG:
+			if (!notify_base) {
+				notify_base = bl_virtio_blk_map_cap(i, cap);
+				notify_cap = cap;
+			}
+			break;
+
+		case BL_VIRTIO_PCI_CAP_DEVICE_CFG:
+			if (!device->device_cfg)
+				device->device_cfg = bl_virtio_blk_map_cap(i, cap);
+			break;
+		}
+	}
+
+	if (!device->common || !device->device_cfg || !notify_base)
+		return BL_STATUS_UNSUPPORTED;
+
+	/* Queue 0 was selected while setting it up. */
+	device->common->queue_select = 0;
+	device->notify = (volatile bl_uint16_t *)(notify_base + device->common->queue_notify_off *
+		bl_pci_read_config_long(i.bus, i.dev, i.func, notify_cap + BL_VIRTIO_PCI_CAP_NOTIFY_MULT));
+
+	return BL_STATUS_SUCCESS;
+}
+
+static bl_status_t bl_virtio_blk_init(struct bl_virtio_blk_device *device)
+{
+	bl_status_t status;
+	bl_uint32_t features, size_max;
+
+	/* Reset & let the device know it was found. */
+	bl_virtio_blk_set_status(device, 0);
+	bl_virtio_blk_set_status(device, BL_VIRTIO_STATUS_ACKNOWLEDGE | BL_VIRTIO_STATUS_DRIVER);
+
+	status = bl_virtio_blk_negotiate(device, &features);
+	if (status)
+		goto _failed;
+
+	status = bl_virtio_blk_setup_queue(device);
+	if (status)
+		goto _failed;
+
+	device->capacity = bl_virtio_blk_read_config(device, BL_VIRTIO_BLK_CONFIG_CAPACITY) |
+		((bl_uint64_t)bl_virtio_blk_read_config(device, BL_VIRTIO_BLK_CONFIG_CAPACITY + 4) << 32);
+
+	device->max_sectors = BL_VIRTIO_BLK_MAX_SECTORS;
+	if (features & (1 << BL_VIRTIO_BLK_F_SIZE_MAX)) {
+		size_max = bl_virtio_blk_read_config(device, BL_VIRTIO_BLK_CONFIG_SIZE_MAX);
+		device->max_sectors = BL_MAX(BL_MIN(device->max_sectors,
+			size_max / BL_STORAGE_SECTOR_SIZE), 1);
+	}
+
+	bl_virtio_blk_set_status(device, bl_virtio_blk_get_status(device) |
+		BL_VIRTIO_STATUS_DRIVER_OK);
+
+	return BL_STATUS_SUCCESS;
+
+_failed:
+	bl_virtio_blk_set_status(device, BL_VIRTIO_STATUS_FAILED);
+
+	return status;
+}
+
+static bl_status_t bl_virtio_blk_pci_initialize(struct bl_pci_index i)
+{
+	bl_status_t status;
+	bl_uint16_t device_id;
+	bl_uint32_t bar;
+	struct bl_virtio_blk_device *device;
+
+	if (bl_pci_read_config_word(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_VENDOR_ID) !=
+			BL_VIRTIO_PCI_VENDOR_ID)
+		return BL_STATUS_FAILURE;
+
+	device_id = bl_pci_read_config_word(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_DEVICE_ID);
+	if (device_id != BL_VIRTIO_PCI_DEVICE_ID_BLK_LEGACY &&
+			device_id != BL_VIRTIO_PCI_DEVICE_ID_BLK_MODERN)
+		return BL_STATUS_FAILURE;
+
+	device = bl_heap_alloc(sizeof(struct bl_virtio_blk_device));
+	if (!device)
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	bl_pci_write_config_word(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_COMMAND,
+		bl_pci_read_config_word(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_COMMAND) |
+			BL_PCI_COMMAND_IO_SPACE | BL_PCI_COMMAND_MEMORY_SPACE |
+			BL_PCI_COMMAND_BUS_MASTER);
+
+	/* Prefer the modern interface, transitional devices have both. */
+	device->modern = !bl_virtio_blk_find_caps(i, device);
+	if (!device->modern) {
+		bar = bl_pci_read_config_long(i.bus, i.dev, i.func, BL_PCI_CONFIG_REG_BAR0);
+		if (device_id != BL_VIRTIO_PCI_DEVICE_ID_BLK_LEGACY || !(bar & BL_VIRTIO_PCI_BAR_IO)) {
+			status = BL_STATUS_UNSUPPORTED;
+			goto _exit;
+		}
+
+		device->io = bar & BL_VIRTIO_PCI_BAR_IO_BA;
+	}
+
+	status = bl_virtio_blk_init(device);
+	if (status)
+		goto _exit;
+
+	bl_virtio_blk_device_add(device);
+
+	return BL_STATUS_SUCCESS;
+
+_exit:
+	bl_heap_free(device, sizeof(struct bl_virtio_blk_device));
+
+	return status;
+}
+
+static struct bl_disk_controller_functions virtio_blk_functions = {
+	.type = BL_DISK_CONTROLLER_TYPE_VIRTIO_BLK,
+	.read = bl_virtio_blk_read,
+	.readv = bl_virtio_blk_readv,
+	.submit = bl_virtio_blk_submit,
+	.poll = bl_virtio_blk_poll,
+	.get_info = NULL,
+};
+
+BL_MODULE_INIT()
+{
+	struct bl_virtio_blk_device *device;
+	struct bl_disk_controller *controller;
+
+	bl_pci_iterate_devices(bl_virtio_blk_pci_initialize);
+
+	controller = bl_heap_alloc(sizeof(struct bl_disk_controller));
+	if (!controller)
+		return;
+
+	controller->funcs = &virtio_blk_functions;
+	controller->data = NULL;
+	controller->probe_us = 0;
+	controller->next = NULL;
+
+	bl_disk_controller_register(controller);
+
+	device = bl_virtio_blk_device_list;
+	while (device) {
+		struct bl_storage_device *disk;
+
+		disk = bl_heap_alloc(sizeof(struct bl_storage_device));
+		if (!disk)
+			return;
+
+		disk->type = BL_STORAGE_TYPE_HARD_DRIVE;
+		disk->controller = controller;
+		disk->sector_size = BL_STORAGE_SECTOR_SIZE;
+		disk->sector_count = device->capacity;
+		disk->data = device;
+		disk->next = NULL;
+
+		bl_storage_device_register(disk);
+
+		/* Several requests can sit in the available ring. */
+		bl_storage_device_set_queue_depth(disk, device->slots);
+
+		device = device->next;
+	}
+}
+
+BL_MODULE_UNINIT()
+{
+
+}
@@ -0,0 +1,154 @@
+#ifndef BL_VIRTIO_BLK_H
+#define BL_VIRTIO_BLK_H
+
+#include "include/bl-types.h"
+
+/* PCI IDs. */
+#define BL_VIRTIO_PCI_VENDOR_ID			0x1af4
+#define BL_VIRTIO_PCI_DEVICE_ID_BLK_LEGACY	0x1001
+#define BL_VIRTIO_PCI_DEVICE_ID_BLK_MODERN	0x1042
+
+/* Device status. */
+enum {
+	BL_VIRTIO_STATUS_ACKNOWLEDGE	= (1 << 0),
+	BL_VIRTIO_STATUS_DRIVER		= (1 << 1),
+	BL_VIRTIO_STATUS_DRIVER_OK	= (1 << 2),
+	BL_VIRTIO_STATUS_FEATURES_OK	= (1 << 3),
+	BL_VIRTIO_STATUS_FAILED		= (1 << 7),
+};
+
+/* Feature bits. */
+#define BL_VIRTIO_BLK_F_SIZE_MAX	1
+#define BL_VIRTIO_F_VERSION_1		32
+
+/* Legacy interface - registers in the I/O BAR0. */
+enum {
+	BL_VIRTIO_LEGACY_DEVICE_FEATURES	= 0x00,
+	BL_VIRTIO_LEGACY_GUEST_FEATURES		= 0x04,
+	BL_VIRTIO_LEGACY_QUEUE_ADDRESS		= 0x08,
+	BL_VIRTIO_LEGACY_QUEUE_SIZE		= 0x0c,
+	BL_VIRTIO_LEGACY_QUEUE_SELECT		= 0x0e,
+	BL_VIRTIO_LEGACY_QUEUE_NOTIFY		= 0x10,
+	BL_VIRTIO_LEGACY_DEVICE_STATUS		= 0x12,
+	BL_VIRTIO_LEGACY_ISR_STATUS		= 0x13,
+	BL_VIRTIO_LEGACY_DEVICE_CONFIG		= 0x14,
+};
+
+#define BL_VIRTIO_PCI_BAR_IO		(1 << 0)
+#define BL_VIRTIO_PCI_BAR_IO_BA		(0xfffc)
+#define BL_VIRTIO_PCI_BAR_MEM_BA	(0xfffffff0)
+#define BL_VIRTIO_PCI_BAR_TYPE_64	(2 << 1)
+
+/* Modern interface - structures found through vendor specific PCI capabilities. */
+#define BL_VIRTIO_PCI_CAP_ID_VENDOR	0x09
+
+enum {
+	BL_VIRTIO_PCI_CAP_COMMON_CFG	= 1,
+	BL_VIRTIO_PCI_CAP_NOTIFY_CFG	= 2,
+	BL_VIRTIO_PCI_CAP_ISR_CFG	= 3,
+	BL_VIRTIO_PCI_CAP_DEVICE_CFG	= 4,
+};
+
+/* Offsets within the capability. */
+enum {
+	BL_VIRTIO_PCI_CAP_NEXT		= 1,
+	BL_VIRTIO_PCI_CAP_CFG_TYPE	= 3,
+	BL_VIRTIO_PCI_CAP_BAR		= 4,
+	BL_VIRTIO_PCI_CAP_OFFSET	= 8,
+	BL_VIRTIO_PCI_CAP_LENGTH	= 12,
+	BL_VIRTIO_PCI_CAP_NOTIFY_MULT	= 16,
+};
+
+struct bl_virtio_pci_common_cfg {
+	__u32	device_feature_select;
+	__u32	device_feature;
+	__u32	driver_feature_select;
+	__u32	driver_feature;
+	__u16	msix_config;
+	__u16	num_queues;
+	__u8	device_status;
+	__u8	config_generation;
+	__u16	queue_select;
+	__u16	queue_size;
+	__u16	queue_msix_vector;
+	__u16	queue_enable;
+	__u16	queue_notify_off;
+	__u32	queue_desc;
+	__u32	queue_desc_hi;
+	__u32	queue_driver;
+	__u32	queue_driver_hi;
+	__u32	queue_device;
+	__u32	queue_device_hi;
+} __attribute__((packed));
+
+/* Block device configuration, common for both interfaces. */
+enum {
+	BL_VIRTIO_BLK_CONFIG_CAPACITY	= 0x00,
+	BL_VIRTIO_BLK_CONFIG_SIZE_MAX	= 0x08,
+};
+
+/* Split virtqueue. */
+struct bl_virtq_desc {
+	__u64	addr;
+	__u32	len;
+	__u16	flags;
+	__u16	next;
+} __attribute__((packed));
+
+enum {
+	BL_VIRTQ_DESC_F_NEXT	= (1 << 0),
+	BL_VIRTQ_DESC_F_WRITE	= (1 << 1),
+};
+
+struct bl_virtq_avail {
+	__u16	flags;
+	__u16	idx;
+	__u16	ring[0];
+} __attribute__((packed));
+
+struct bl_virtq_used_elem {
+	__u32	id;
+	__u32	len;
+} __attribute__((packed));
+
+struct bl_virtq_used {
+	__u16	flags;
+	__u16	idx;
+	struct bl_virtq_used_elem ring[0];
+} __attribute__((packed));
+
+/* Legacy devices expect the used ring on the next page boundary. */
+#define BL_VIRTQ_ALIGN	0x1000
+
+/* Block requests. */
+enum {
+	BL_VIRTIO_BLK_T_IN	= 0,
+};
+
+enum {
+	BL_VIRTIO_BLK_S_OK	= 0,
+};
+
+struct bl_virtio_blk_req_header {
+	__u32	type;
+	__u32	reserved;
+	__u64	sector;
+} __attribute__((packed));
+
+/*
+ * Every request is a chain of three descriptors - header, data & status. Request
+ * slots own fixed descriptors and are tracked in 32-bit masks.
+ */
+#define BL_VIRTIO_BLK_DESCS_PER_REQUEST	3
+#define BL_VIRTIO_BLK_MAX_REQUESTS	32
+
+/* Largest queue set up, legacy devices don't allow picking a smaller one. */
+#define BL_VIRTIO_BLK_MAX_QUEUE_SIZE	256
+
+/* Sectors per request when the device doesn't limit it. */
+#define BL_VIRTIO_BLK_MAX_SECTORS	0x10000
+
+/* Microseconds to wait for requests. */
+#define BL_VIRTIO_BLK_TIMEOUT	1000000
+
+#endif
@@ -117,14 +117,8 @@ static void bl_ehci_port_reset(struct bl_usb_host_controller *hc, int port)
 	/* First disable the port. */
 	ehci->op_regs->port_sc[port] &= ~BL_EHCI_OP_REG_PORTSC_ENABLED;
 
-	int timeout = 10;
-	while (--timeout) {
-		if ((ehci->op_regs->port_sc[port] & BL_EHCI_OP_REG_PORTSC_ENABLED)
-			== 0)
-			break;
-
-		bl_time_sleep(1);
-	}
+	bl_poll_until((ehci->op_regs->port_sc[port] & BL_EHCI_OP_REG_PORTSC_ENABLED) == 0,
+			10000);
 
 	if (ehci->op_regs->port_sc[port] & BL_EHCI_OP_REG_PORTSC_ENABLED_CHANGE)
 		return;
@@ -436,15 +430,11 @@ static bl_status_t bl_ehci_check_transfer_timeout(volatile struct bl_ehci_qh *qh
 {
 	bl_status_t status;
 
-	while (--timeout) {
-		bl_time_sleep(1);
-
-		status = bl_ehci_transfer_finished(qh);
-		if (!status) {
-			bl_ehci_free_qtd_list(qh);
-			return status;
-		} else if (status == BL_STATUS_USB_SHOULD_CHECK_STATUS)
-			break;
+	bl_poll_until((status = bl_ehci_transfer_finished(qh)) !=
+			BL_STATUS_USB_ACTION_NOT_FINISHED, timeout * 1000);
+	if (!status) {
+		bl_ehci_free_qtd_list(qh);
+		return status;
 	}
 
 	bl_print_str("EHCI transfer error\n");
@@ -634,13 +624,7 @@ static bl_status_t bl_ehci_controller_init(struct bl_ehci_controller *ehci)
 	/* Reset EHCI. */
 	ehci->op_regs->usb_cmd |= BL_EHCI_OP_REG_USBCMD_HC_RESET;
 
-	int timeout = 50;
-	while (--timeout) {
-		if ((ehci->op_regs->usb_cmd & BL_EHCI_OP_REG_USBCMD_HC_RESET) == 0)
-			break;
-
-		bl_time_sleep(1);
-	}
+	bl_poll_until((ehci->op_regs->usb_cmd & BL_EHCI_OP_REG_USBCMD_HC_RESET) == 0, 50000);
 
 	if (ehci->op_regs->usb_cmd & BL_EHCI_OP_REG_USBSTS_HC_HALTED)
 		return BL_STATUS_USB_INTERNAL_ERROR;
@@ -725,6 +709,7 @@ BL_MODULE_INIT()
 		hc->funcs = &ehci_functions;
 		hc->data = (void *)ehci;
 		hc->root_hub.ports = bl_ehci_number_of_ports(ehci);
+		hc->max_bulk_packets = BL_EHCI_NUM_QTDS / 2;
 
 		bl_usb_host_controller_register(hc);
 
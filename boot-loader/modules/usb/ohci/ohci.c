@@ -304,15 +304,10 @@ static bl_status_t bl_ohci_check_transfer_timeout(volatile struct bl_ohci_ed *ed
 {
 	bl_status_t status;
 
-	while (--timeout) {
-		status = bl_ohci_transfer_finished(ed);
-		if (!status)
-			return status;
-		else if (status == BL_STATUS_USB_SHOULD_CHECK_STATUS)
-			break;
-
-		bl_time_sleep(1);
-	}
+	bl_poll_until((status = bl_ohci_transfer_finished(ed)) !=
+			BL_STATUS_USB_ACTION_NOT_FINISHED, timeout * 1000);
+	if (!status)
+		return status;
 
 	return bl_ohci_transfer_status(ed);
 }
@@ -714,6 +709,7 @@ BL_MODULE_INIT()
 		hc->funcs = &ohci_functions;
 		hc->data = (void *)ohci;
 		hc->root_hub.ports = ohci->regs->rh_descriptor_a & BL_OHCI_REG_RH_DESCRIPTOR_A_NDP;
+		hc->max_bulk_packets = BL_OHCI_NUM_GENERAL_TDS / 2;
 
 		bl_usb_host_controller_register(hc);
 
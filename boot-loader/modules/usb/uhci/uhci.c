@@ -244,15 +244,10 @@ static bl_status_t bl_uhci_check_transfer_timeout(volatile struct bl_uhci_qh *qh
 {
 	bl_status_t status;
 
-	while (--timeout) {
-		status = bl_uhci_transfer_finished(qh);
-		if (!status)
-			return status;
-		else if (status == BL_STATUS_USB_SHOULD_CHECK_STATUS)
-			break;
-
-		bl_time_sleep(1);
-	}
+	bl_poll_until((status = bl_uhci_transfer_finished(qh)) !=
+			BL_STATUS_USB_ACTION_NOT_FINISHED, timeout * 1000);
+	if (!status)
+		return status;
 
 	return bl_uhci_transfer_status(qh);
 }
@@ -556,6 +551,7 @@ BL_MODULE_INIT()
 		hc->funcs = &uhci_functions;
 		hc->data = uhci;
 		hc->root_hub.ports = 2;
+		hc->max_bulk_packets = BL_UHCI_NUM_TD / 2;
 
 		bl_usb_host_controller_register(hc);
 
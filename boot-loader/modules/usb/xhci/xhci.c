@@ -17,6 +17,12 @@ BL_MODULE_NAME("USB XHCI");
 
 #define BL_XHCI_TR_TRBS	128
 
+/*
+ * TRBs free for a TD - transfers wait for completion, so the ring is drained before
+ * the next one. The Link TRB and a slot telling a full ring from an empty one aren't.
+ */
+#define BL_XHCI_TR_FREE_TRBS	(BL_XHCI_TR_TRBS - 2)
+
 #define BL_XHCI_CR_TRBS	128
 
 #define BL_XHCI_ER_TRBS	32
@@ -25,6 +31,13 @@ struct bl_xhci_device {
 	int slot_id;
 
 	volatile union bl_xhci_trb *tr_enqueue[31], *tr[31];
+	int tr_cycle[31];
+
+	/* Bulk streams - Stream Context Array and a ring for each stream of the endpoint. */
+	int streams[31];
+	volatile struct bl_xhci_stream_context *stream_ctx[31];
+	volatile union bl_xhci_trb **stream_tr_enqueue[31];
+	int *stream_tr_cycle[31];
 
 	volatile struct bl_xhci_input_context *ic;
 
@@ -119,16 +132,8 @@ static volatile union bl_xhci_trb *bl_xhci_cr_queue_trb(struct bl_xhci_controlle
 
 	xhci->db_regs[0] = 0x0;
 
-	int timeout = 20;
-	while (--timeout) {
-		event = bl_xhci_get_last_event(xhci);
-		if (event) {
-			foo(event);
-			break;
-		}
-
-		bl_time_sleep(1);
-	}
+	if (bl_poll_until((event = bl_xhci_get_last_event(xhci)) != NULL, 20000))
+		foo(event);
 
 	if (!event)
 		return NULL;
@@ -186,11 +191,37 @@ static volatile union bl_xhci_trb *bl_xhci_alloc_transfer_ring(void)
 	/* Last element, Link TRB. */
 	tr[BL_XHCI_TR_TRBS - 1].link.ring_segment_pointer = (bl_uint64_t)&tr[0];
 
-	tr[BL_XHCI_TR_TRBS - 1].link.control |= BL_XHCI_TRB_TYPE(BL_XHCI_TR_TRB_LINK);
+	tr[BL_XHCI_TR_TRBS - 1].link.control |= BL_XHCI_TRB_TYPE(BL_XHCI_TR_TRB_LINK) |
+		BL_XHCI_TRB_TC;
 
 	return tr;
 }
 
+/*
+ * Copy a TRB to the Transfer Ring Enqueue Pointer with the Producer Cycle State. On
+ * reaching the Link TRB, hand it over too and wrap, toggling the cycle state.
+ */
+static void bl_xhci_tr_queue_trb(volatile union bl_xhci_trb **enqueue, int *cycle,
+	union bl_xhci_trb *td)
+{
+	volatile union bl_xhci_trb *trb;
+
+	trb = *enqueue;
+
+	trb->template.parameter = td->template.parameter;
+	trb->template.status = td->template.status;
+	trb->template.control = (td->template.control & ~BL_XHCI_TRB_C) | *cycle;
+
+	trb = ++(*enqueue);
+
+	if (BL_XHCI_TRB_GET_TYPE(trb->link.control) == BL_XHCI_TR_TRB_LINK) {
+		trb->link.control = (trb->link.control & ~BL_XHCI_TRB_C) | *cycle;
+
+		*enqueue = trb - (BL_XHCI_TR_TRBS - 1);
+		*cycle ^= 1;
+	}
+}
+
 static void bl_xhci_device_slot_init(struct bl_xhci_controller *xhci, int port, int slot_id,
 	bl_usb_speed_t speed, int address)
 {
@@ -269,8 +300,11 @@ static void bl_xhci_device_slot_init(struct bl_xhci_controller *xhci, int port,
 	if (!xhci->devices[address])
 		return;
 
+	bl_memset(xhci->devices[address], 0, sizeof(struct bl_xhci_device));
+
 	xhci->devices[address]->slot_id = slot_id;
 	xhci->devices[address]->tr_enqueue[0] = xhci->devices[address]->tr[0] = tr;
+	xhci->devices[address]->tr_cycle[0] = 1;
 	xhci->devices[address]->ic = ic;
 	xhci->devices[address]->dc = dc;
 }
@@ -388,7 +422,7 @@ static bl_status_t bl_xhci_control_transfer(struct bl_usb_host_controller *hc,
 	int off = 0;
 	int max_packet_size;
 	struct bl_xhci_controller *xhci;
-	volatile union bl_xhci_trb *trb, *event;
+	volatile union bl_xhci_trb *event;
 	union bl_xhci_trb td1, td2, td3;
 
 	xhci = hc->data;
@@ -415,13 +449,8 @@ static bl_status_t bl_xhci_control_transfer(struct bl_usb_host_controller *hc,
 	td1.setup.c = 1;
 
 	/* Advance Endpoint 0 Transfer Ring Enqueue Pointer. */
-	trb = xhci->devices[address]->tr_enqueue[0];
-
-	trb->template.parameter = td1.template.parameter;
-	trb->template.status = td1.template.status;
-	trb->template.control = td1.template.control;
-
-	xhci->devices[address]->tr_enqueue[0]++;
+	bl_xhci_tr_queue_trb(&xhci->devices[address]->tr_enqueue[0],
+		&xhci->devices[address]->tr_cycle[0], &td1);
 
 	/* Data Stage TD. */
 	while (length > 0) {
@@ -437,13 +466,8 @@ static bl_status_t bl_xhci_control_transfer(struct bl_usb_host_controller *hc,
 		td2.data.c = 1;
 
 		/* Advance Endpoint 0 Transfer Ring Enqueue Pointer. */
-		trb = xhci->devices[address]->tr_enqueue[0];
-
-		trb->template.parameter = td2.template.parameter;
-		trb->template.status = td2.template.status;
-		trb->template.control = td2.template.control;
-
-		xhci->devices[address]->tr_enqueue[0]++;
+		bl_xhci_tr_queue_trb(&xhci->devices[address]->tr_enqueue[0],
+			&xhci->devices[address]->tr_cycle[0], &td2);
 
 		length -= packet_size;
 		off += packet_size;
@@ -459,27 +483,14 @@ static bl_status_t bl_xhci_control_transfer(struct bl_usb_host_controller *hc,
 	td3.status.c = 1;
 
 	/* Advance Endpoint 0 Transfer Ring Enqueue Pointer. */
-	trb = xhci->devices[address]->tr_enqueue[0];
-
-	trb->template.parameter = td3.template.parameter;
-	trb->template.status = td3.template.status;
-	trb->template.control = td3.template.control;
-
-	xhci->devices[address]->tr_enqueue[0]++;
+	bl_xhci_tr_queue_trb(&xhci->devices[address]->tr_enqueue[0],
+		&xhci->devices[address]->tr_cycle[0], &td3);
 
 	/* Doorbell ring. */
 	xhci->db_regs[xhci->devices[address]->slot_id] = 1;
 
-	int timeout = 20;
-	while (--timeout) {
-		event = bl_xhci_get_last_event(xhci);
-		if (event) {
-			foo(event);
-			break;
-		}
-
-		bl_time_sleep(1);
-	}
+	if (bl_poll_until((event = bl_xhci_get_last_event(xhci)) != NULL, 20000))
+		foo(event);
 
 	return BL_STATUS_SUCCESS;
 }
@@ -516,110 +527,198 @@ static void bl_xhci_cr_evaluate_context(struct bl_xhci_controller *xhci,
 }
 #endif
 
-static void bl_xhci_bulk_transfer(struct bl_usb_host_controller *hc,
-	int address, struct bl_usb_endpoint *endp, bl_usb_speed_t speed,
-	int direction, bl_uint8_t *data, int length)
+/* Linear Primary Stream Context Array with a Transfer Ring for streams 1..streams. */
+static bl_status_t bl_xhci_alloc_stream_rings(struct bl_xhci_controller *xhci,
+	struct bl_xhci_device *device, int ep, int *streams, int *pstreams)
+{
+	int i, entries, max_pstreams;
+	volatile union bl_xhci_trb *tr;
+
+	max_pstreams = BL_XHCI_HCCPARAMS1_MAXPSASIZE(xhci->cap_regs->hccparams1);
+	if (!max_pstreams)
+		return BL_STATUS_UNSUPPORTED;
+
+	/* 2^(MaxPStreams + 1) entries, stream 0 is reserved. */
+	for (*pstreams = 1; *pstreams < max_pstreams && (1 << (*pstreams + 1)) < *streams + 1;)
+		(*pstreams)++;
+
+	entries = 1 << (*pstreams + 1);
+	*streams = BL_MIN(*streams, entries - 1);
+
+	/* Aligned to its size, so it doesn't cross a page. */
+	device->stream_ctx[ep - 1] = bl_heap_alloc_align(entries *
+		sizeof(struct bl_xhci_stream_context), entries * sizeof(struct bl_xhci_stream_context));
+	if (!device->stream_ctx[ep - 1])
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	bl_memset((void *)device->stream_ctx[ep - 1], 0, entries * sizeof(struct bl_xhci_stream_context));
+
+	device->stream_tr_enqueue[ep - 1] = bl_heap_alloc((*streams + 1) *
+		sizeof(volatile union bl_xhci_trb *));
+	if (!device->stream_tr_enqueue[ep - 1])
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	device->stream_tr_cycle[ep - 1] = bl_heap_alloc((*streams + 1) * sizeof(int));
+	if (!device->stream_tr_cycle[ep - 1])
+		return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+	for (i = 1; i <= *streams; i++) {
+		tr = bl_xhci_alloc_transfer_ring();
+		if (!tr)
+			return BL_STATUS_MEMORY_ALLOCATION_FAILED;
+
+		device->stream_ctx[ep - 1][i].tr_dequeue_pointer = (bl_uint64_t)tr |
+			BL_XHCI_STREAM_CONTEXT_SCT(BL_XHCI_SCT_PRIMARY_TR) | 1 /* DCS */;
+		device->stream_tr_enqueue[ep - 1][i] = tr;
+		device->stream_tr_cycle[ep - 1][i] = 1;
+	}
+
+	device->streams[ep - 1] = *streams;
+
+	return BL_STATUS_SUCCESS;
+}
+
+/* Configure a bulk endpoint, with a single Transfer Ring if streams is 0. */
+static bl_status_t bl_xhci_configure_bulk_endpoint(struct bl_xhci_controller *xhci,
+	int address, struct bl_usb_endpoint *endp, int *streams)
 {
-	int ep, off = 0, packet_size;
+	int ep, pstreams;
 	bl_uint8_t addr;
-	struct bl_xhci_controller *xhci;
-	union bl_xhci_trb td;
-	volatile union bl_xhci_trb *tr, *trb, *event;
+	bl_status_t status;
+	struct bl_xhci_device *device;
+	volatile union bl_xhci_trb *tr;
 	volatile struct bl_xhci_endpoint_context *ep_context;
 
-	bl_print_str("Bulk\n");
-
-	xhci = hc->data;
+	device = xhci->devices[address];
 
 	addr = endp->descriptor->endpoint_address;
 	ep = 2 * BL_USB_ENDPOINT_ADDRESS(addr) + BL_USB_ENDPOINT_DIRECTION(addr);
-	bl_print_str("EP : ");
-	bl_print_hex(ep);
-	bl_print_str(" ");
-	bl_print_hex(address);
-	bl_print_str("\n");
 
-	packet_size = endp->descriptor->max_packet_size;
-
-	ep_context = &xhci->devices[address]->ic->ep_context[ep - 2];
+	ep_context = &device->ic->ep_context[ep - 2];
 
-	if (ep_context->ep_type == BL_XHCI_EP_TYPE_NOT_VALID) {
-		if (BL_USB_ENDPOINT_DIRECTION(addr))
-			ep_context->ep_type = BL_XHCI_EP_TYPE_BULK_IN;
-		else
-			ep_context->ep_type = BL_XHCI_EP_TYPE_BULK_OUT;
+	if (BL_USB_ENDPOINT_DIRECTION(addr))
+		ep_context->ep_type = BL_XHCI_EP_TYPE_BULK_IN;
+	else
+		ep_context->ep_type = BL_XHCI_EP_TYPE_BULK_OUT;
 
-		ep_context->max_packet_size = packet_size;
+	ep_context->max_packet_size = endp->descriptor->max_packet_size;
 
-		// TODO: USB3 bMaxBurst
-		ep_context->max_burst_size = 0;
+	// TODO: USB3 bMaxBurst
+	ep_context->max_burst_size = 0;
 
-		ep_context->cerr = 3;
+	ep_context->cerr = 3;
 
-		// TODO: Streams.
+	if (*streams) {
+		status = bl_xhci_alloc_stream_rings(xhci, device, ep, streams, &pstreams);
+		if (status)
+			return status;
 
+		ep_context->max_pstreams = pstreams;
+		ep_context->lsa = 1;
+		ep_context->tr_dequeue_pointer = (bl_uint64_t)device->stream_ctx[ep - 1];
+	} else {
 		ep_context->max_pstreams = 0;
 
 		tr = bl_xhci_alloc_transfer_ring();
 		if (!tr)
-			return;
+			return BL_STATUS_MEMORY_ALLOCATION_FAILED;
 
 		ep_context->tr_dequeue_pointer = (bl_uint64_t)tr | 1;
-		xhci->devices[address]->tr_enqueue[ep - 1] = xhci->devices[address]->tr[ep - 1] = tr;
+		device->tr_enqueue[ep - 1] = device->tr[ep - 1] = tr;
+		device->tr_cycle[ep - 1] = 1;
+	}
 
-		//ep_context->tr_dequeue_pointer = (bl_uint64_t)xhci->devices[address]->tr[0] | 1;
+	/* Only this endpoint, adding running ones again would reset their rings. */
+	device->ic->icc.add_context_flags = BL_XHCI_INPUT_CONTROL_CONTEXT_A(0) |
+		BL_XHCI_INPUT_CONTROL_CONTEXT_A(ep);
+	device->ic->icc.drop_context_flags &= ~BL_XHCI_INPUT_CONTROL_CONTEXT_A(ep);
 
-		xhci->devices[address]->ic->icc.add_context_flags |= BL_XHCI_INPUT_CONTROL_CONTEXT_A(ep);
-		xhci->devices[address]->ic->icc.drop_context_flags &= ~BL_XHCI_INPUT_CONTROL_CONTEXT_A(ep);
+	device->ic->slot.context_entries = BL_MAX(device->ic->slot.context_entries, ep);
 
-		xhci->devices[address]->ic->slot.context_entries = ep;
+	bl_xhci_cr_configure_endpoint(xhci, device->ic, device->slot_id);
 
-		bl_xhci_cr_configure_endpoint(xhci, xhci->devices[address]->ic, xhci->devices[address]->slot_id);
+	if (device->dc->ep_context[ep - 2].ep_state != BL_XHCI_EP_STATE_RUNNING)
+		return BL_STATUS_USB_INTERNAL_ERROR;
 
-		if (xhci->devices[address]->dc->ep_context[ep - 2].ep_state != BL_XHCI_EP_STATE_RUNNING)
-			return;
-	}
+	return BL_STATUS_SUCCESS;
+}
 
-	while (length > 0) {
-		bl_memset(&td, 0, sizeof(union bl_xhci_trb));
+static bl_status_t bl_xhci_alloc_streams(struct bl_usb_host_controller *hc,
+	int address, struct bl_usb_endpoint *endp, int *streams)
+{
+	if (*streams < 1)
+		return BL_STATUS_INVALID_PARAMETERS;
 
-		td.normal.trb_type = BL_XHCI_TR_TRB_NORMAL;
-		td.normal.data_buffer_pointer = (bl_uint64_t)data + off;
-		td.normal.transfer_length = BL_MIN(length, packet_size);
-		td.normal.td_size = 0;
-		td.normal.c = 0;
-		td.normal.ent = 0;
-		td.normal.ch = length > packet_size;
-		td.normal.ioc = 0;
-		td.normal.idt = 0;
-		td.normal.bei = 0;
+	return bl_xhci_configure_bulk_endpoint(hc->data, address, endp, streams);
+}
 
-		trb = xhci->devices[address]->tr_enqueue[ep - 1];
+static void bl_xhci_bulk_transfer(struct bl_usb_host_controller *hc,
+	int address, struct bl_usb_endpoint *endp, bl_usb_speed_t speed,
+	int direction, bl_uint8_t *data, int length)
+{
+	int ep, off = 0, packet_size, streams, stream_id, *cycle, trbs;
+	bl_uint8_t addr;
+	struct bl_xhci_controller *xhci;
+	struct bl_xhci_device *device;
+	union bl_xhci_trb td;
+	volatile union bl_xhci_trb **enqueue, *event;
 
-		trb->template.parameter = td.template.parameter;
-		trb->template.status = td.template.status;
-		trb->template.control = td.template.control;
+	xhci = hc->data;
+	device = xhci->devices[address];
 
-		foo(trb);
+	addr = endp->descriptor->endpoint_address;
+	ep = 2 * BL_USB_ENDPOINT_ADDRESS(addr) + BL_USB_ENDPOINT_DIRECTION(addr);
 
-		xhci->devices[address]->tr_enqueue[ep - 1]++;
+	packet_size = endp->descriptor->max_packet_size;
 
-		length -= packet_size;
-		off += packet_size;
+	if (device->ic->ep_context[ep - 2].ep_type == BL_XHCI_EP_TYPE_NOT_VALID) {
+		streams = 0;
+		if (bl_xhci_configure_bulk_endpoint(xhci, address, endp, &streams))
+			return;
 	}
 
-	/* Doorbell ring. */
-	xhci->db_regs[xhci->devices[address]->slot_id] = ep;
+	/* Endpoints with streams have a ring for each stream. */
+	stream_id = 0;
+	enqueue = &device->tr_enqueue[ep - 1];
+	cycle = &device->tr_cycle[ep - 1];
 
-	int timeout = 20;
-	while (--timeout) {
-		event = bl_xhci_get_last_event(xhci);
-		if (event) {
-			foo(event);
-			break;
+	if (device->streams[ep - 1]) {
+		stream_id = endp->stream_id;
+		if (stream_id < 1 || stream_id > device->streams[ep - 1])
+			return;
+
+		enqueue = &device->stream_tr_enqueue[ep - 1][stream_id];
+		cycle = &device->stream_tr_cycle[ep - 1][stream_id];
+	}
+
+	/* Split into TDs that fit in the free part of the ring. */
+	while (length > 0) {
+		for (trbs = 1; length > 0 && trbs <= BL_XHCI_TR_FREE_TRBS; trbs++) {
+			bl_memset(&td, 0, sizeof(union bl_xhci_trb));
+
+			td.normal.trb_type = BL_XHCI_TR_TRB_NORMAL;
+			td.normal.data_buffer_pointer = (bl_uint64_t)data + off;
+			td.normal.transfer_length = BL_MIN(length, packet_size);
+			td.normal.td_size = 0;
+			td.normal.c = 1;
+			td.normal.ent = 0;
+			td.normal.ch = length > packet_size && trbs < BL_XHCI_TR_FREE_TRBS;
+			td.normal.ioc = !td.normal.ch;
+			td.normal.idt = 0;
+			td.normal.bei = 0;
+
+			bl_xhci_tr_queue_trb(enqueue, cycle, &td);
+
+			length -= packet_size;
+			off += packet_size;
 		}
 
-		bl_time_sleep(1);
+		/* Doorbell ring. */
+		xhci->db_regs[device->slot_id] = ep | BL_XHCI_DOORBELL_STREAM_ID(stream_id);
+
+		/* The ring isn't drained, queueing more could overrun it. */
+		if (!bl_poll_until((event = bl_xhci_get_last_event(xhci)) != NULL, 20000))
+			return;
 	}
 }
 
@@ -795,21 +894,12 @@ static bl_status_t bl_xhci_init_data_structures(struct bl_xhci_controller *xhci)
 
 static bl_status_t bl_xhci_controller_init(struct bl_xhci_controller *xhci)
 {
-	int timeout;
 	bl_status_t status;
 
 	xhci->op_regs = (bl_uint8_t *)xhci->cap_regs + xhci->cap_regs->caplength;
 
 	/* Wait for Controller Not Ready (CNR) flag to be 0. */
-	timeout = 1000;
-	while (--timeout) {
-		if ((xhci->op_regs->usbsts & BL_XHCI_USBSTS_CNR) == 0)
-			break;
-
-		bl_time_sleep(1);
-	}
-
-	if (xhci->op_regs->usbsts & BL_XHCI_USBSTS_CNR)
+	if (!bl_poll_until((xhci->op_regs->usbsts & BL_XHCI_USBSTS_CNR) == 0, 1000000))
 		return BL_STATUS_USB_INTERNAL_ERROR;
 	
 	/* Stop XHCI. */
@@ -822,15 +912,7 @@ static bl_status_t bl_xhci_controller_init(struct bl_xhci_controller *xhci)
 	/* Reset XHCI. */
 	xhci->op_regs->usbcmd |= BL_XHCI_USBCMD_HCRST;
 
-	timeout = 50;
-	while (--timeout) {
-		if ((xhci->op_regs->usbcmd & BL_XHCI_USBCMD_HCRST) == 0)
-			break;
-
-		bl_time_sleep(1);
-	}
-
-	if (xhci->op_regs->usbcmd & BL_XHCI_USBCMD_HCRST)
+	if (!bl_poll_until((xhci->op_regs->usbcmd & BL_XHCI_USBCMD_HCRST) == 0, 50000))
 		return BL_STATUS_USB_INTERNAL_ERROR;
 
 	/* Initialize data structures. */
@@ -890,6 +972,7 @@ static struct bl_usb_host_controller_functions bl_xhci_functions = {
 	.port_init = bl_xhci_port_init,
 	.control_transfer = bl_xhci_control_transfer,
 	.bulk_transfer = bl_xhci_bulk_transfer,
+	.alloc_streams = bl_xhci_alloc_streams,
 };
 
 BL_MODULE_INIT()
@@ -909,6 +992,7 @@ BL_MODULE_INIT()
 		hc->funcs = &bl_xhci_functions;
 		hc->data = (void *)xhci;
 		hc->root_hub.ports = BL_XHCI_HCSPARAMS1_MAXPORTS(xhci->cap_regs->hcsparams1);
+		hc->max_bulk_packets = BL_XHCI_TR_FREE_TRBS;
 
 		bl_usb_host_controller_register(hc);
 
@@ -24,6 +24,7 @@ enum {
 #define BL_XHCI_HCSPARAMS2_ERSTMAX(hcsparams2)	((hcsparams2 >> 4) & 0xf)
 
 /* XHCI HCCPARAMS1. */
+#define BL_XHCI_HCCPARAMS1_MAXPSASIZE(hccparams1)	((hccparams1 >> 12) & 0xf)
 #define BL_XHCI_HCCPARAMS1_XECP(hccparams1)	((hccparams1 >> 16) & 0xffff)
 
 /* XHCI RTSOFF. */
@@ -208,6 +209,7 @@ enum {
 /* XHCI template TRB control flags. */
 enum {
 	BL_XHCI_TRB_C		= (1 << 0),
+	BL_XHCI_TRB_TC		= (1 << 1),
 };
 
 #define BL_XHCI_TRB_TYPE(type)		((type & 0x3f) << 10)
@@ -452,6 +454,24 @@ struct bl_xhci_endpoint_context {
 	__u32	reserved3[3];
 } __attribute__((packed));
 
+/* XHCI Stream Context. */
+enum {
+	BL_XHCI_SCT_SECONDARY_TR	= 0,
+	BL_XHCI_SCT_PRIMARY_TR		= 1,
+};
+
+#define BL_XHCI_STREAM_CONTEXT_SCT(sct)	((sct & 0x7) << 1)
+
+struct bl_xhci_stream_context {
+	__u64	tr_dequeue_pointer;
+	__u32	stopped_edtla : 24;
+	__u32	reserved0 : 8;
+	__u32	reserved1;
+} __attribute__((packed));
+
+/* XHCI Doorbell register. */
+#define BL_XHCI_DOORBELL_STREAM_ID(stream_id)	((stream_id & 0xffff) << 16)
+
 /* XHCI Device Context. */
 struct bl_xhci_device_context {
 	struct bl_xhci_slot_context		slot;
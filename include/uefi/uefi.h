@@ -362,6 +362,59 @@ typedef enum {
 	EFI_TIMER_RELATIVE,
 } efi_timer_delay_t;
 
+/* EFI Block I/O media. */
+struct efi_block_io_media {
+	efi_uint32_t media_id;
+	efi_boolean_t removable_media;
+	efi_boolean_t media_present;
+	efi_boolean_t logical_partition;
+	efi_boolean_t read_only;
+	efi_boolean_t write_caching;
+	efi_uint8_t padding0[3];
+	efi_uint32_t block_size;
+	efi_uint32_t io_align;
+	efi_uint8_t padding1[4];
+	efi_uint64_t last_block;
+} __attribute__((packed));
+
+/* EFI Block I/O protocol. */
+#define EFI_BLOCK_IO_PROTOCOL_GUID	\
+	{ 0x964e5b21, 0x6459, 0x11d2, { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } }
+
+struct efi_block_io_protocol {
+	efi_uint64_t revision;
+	struct efi_block_io_media *media;
+
+	efi_status_t (*reset)(struct efi_block_io_protocol *, efi_boolean_t);
+
+	efi_status_t (*read_blocks)(struct efi_block_io_protocol *, efi_uint32_t,
+		efi_uint64_t, efi_uintn_t, void *);
+
+	void *write_blocks;
+	void *flush_blocks;
+} __attribute__((packed));
+
+/* EFI Block I/O 2 protocol. */
+#define EFI_BLOCK_IO2_PROTOCOL_GUID	\
+	{ 0xa77b2472, 0xe282, 0x4e9f, { 0xa2, 0x45, 0xc2, 0xc0, 0xe2, 0x7b, 0xbc, 0xc1 } }
+
+struct efi_block_io2_token {
+	efi_event_t event;
+	efi_status_t transaction_status;
+} __attribute__((packed));
+
+struct efi_block_io2_protocol {
+	struct efi_block_io_media *media;
+
+	efi_status_t (*reset)(struct efi_block_io2_protocol *, efi_boolean_t);
+
+	efi_status_t (*read_blocks_ex)(struct efi_block_io2_protocol *, efi_uint32_t,
+		efi_uint64_t, struct efi_block_io2_token *, efi_uintn_t, void *);
+
+	void *write_blocks_ex;
+	void *flush_blocks_ex;
+} __attribute__((packed));
+
 /* EFI Boot services table. */
 #define EFI_BOOT_SERVICES_SIGNATURE	0x56524553544f4f42
 
@@ -397,7 +450,7 @@ struct efi_boot_services_table {
 
 	efi_status_t (*close_event)(efi_event_t);
 
-	void *check_event;
+	efi_status_t (*check_event)(efi_event_t);
 
 	/* Protocol handler services. */
 	void *install_protocol_interface;